@@ -0,0 +1,431 @@
+/**
+ * @file bench.c
+ * @brief 调度热路径性能测试
+ * @details 在10到1000000个排队作业下，对每种调度算法测量调度时钟（updateall和作业选择）、
+ *          作业结束后的选择、入队和出队每次操作的耗时、内存分配次数和缓存未命中次数，
+ *          使用与调度器相同的调度核心（policy.c）。结果按行输出为制表符分隔或JSON，
+ *          可以保存下来与新版本的结果逐行比较。SJF另外给出逐个扫描全部作业的线性选择作为对照
+ */
+
+#define _GNU_SOURCE     // syscall
+
+#include <stdio.h>       // 标准输入输出
+#include <stdlib.h>      // 动态内存分配
+#include <stdint.h>      // 定长整数类型
+#include <string.h>      // 字符串处理
+#include <strings.h>     // strcasecmp
+#include <time.h>        // 时钟
+#include <unistd.h>      // getopt、read
+#include <sys/ioctl.h>   // 性能计数器控制
+#include <sys/syscall.h> // perf_event_open
+#include <linux/perf_event.h>   // 性能计数器定义
+#include "policy.h"      // 调度核心
+#include "queue.h"       // 就绪队列
+#include "pool.h"        // 作业记录内存池
+
+#define MAXDEPTH 1000000    // 默认最大队列长度
+#define NOPS 200000         // 每项测量的最多操作次数
+#define BUDGET_NS 500000000ULL  // 每项测量的时间预算，选择开销大的算法提前结束
+#define NBATCH 10000        // 入队、出队每批的作业数上限
+#define NSCAN 200           // 线性扫描的最大测量次数
+#define QUANTUM 10          // 调度时钟周期（单位：毫秒）
+
+void *__libc_malloc(size_t size);
+void *__libc_calloc(size_t n, size_t size);
+void *__libc_realloc(void *p, size_t size);
+
+volatile int sink;          // 保存测量结果，防止编译器删除被测代码
+unsigned long nalloc = 0;   // 内存分配次数
+int perffd = -1;            // 缓存未命中计数器，-1表示不可用
+int json = 0;               // 是否输出JSON
+struct jobqueue jobs;       // 全部作业，按到达顺序排列
+struct jobindex jidindex;   // 作业ID到作业的索引
+int jobid = 0;              // 作业ID计数器
+int *live = NULL;           // 排队作业的ID，出队时从中随机选取
+int nlive = 0;              // 排队作业数
+
+// 一项测量的累计值，可以分多段累计
+struct counter {
+	uint64_t ns;            // 耗时（单位：纳秒）
+	uint64_t misses;        // 缓存未命中次数
+	unsigned long allocs;   // 内存分配次数
+	long ops;               // 操作次数
+	uint64_t t0, m0;        // 本段开始时的时钟和计数器
+	unsigned long a0;       // 本段开始时的分配次数
+};
+
+/**
+ * @brief 统计内存分配次数的malloc，实际分配交给C库
+ */
+void *malloc(size_t size)
+{
+	nalloc++;
+	return __libc_malloc(size);
+}
+
+void *calloc(size_t n, size_t size)
+{
+	nalloc++;
+	return __libc_calloc(n, size);
+}
+
+void *realloc(void *p, size_t size)
+{
+	nalloc++;
+	return __libc_realloc(p, size);
+}
+
+/**
+ * @brief 读取单调时钟
+ * @return 当前时刻（单位：纳秒）
+ */
+uint64_t now_ns()
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/**
+ * @brief 打开本进程用户态的缓存未命中计数器
+ * @return 计数器文件描述符，内核或虚拟机不支持、权限不足时返回-1
+ */
+int perf_open()
+{
+	struct perf_event_attr attr;
+	int fd;
+
+	memset(&attr, 0, sizeof(attr));
+	attr.size = sizeof(attr);
+	attr.type = PERF_TYPE_HARDWARE;
+	attr.config = PERF_COUNT_HW_CACHE_MISSES;
+	attr.exclude_kernel = 1;
+	attr.exclude_hv = 1;
+	if ((fd = syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0)) < 0)
+		return -1;
+	ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+	return fd;
+}
+
+/**
+ * @brief 读取缓存未命中计数器
+ */
+uint64_t perf_read()
+{
+	uint64_t v = 0;
+
+	if (perffd >= 0 && read(perffd, &v, sizeof(v)) != sizeof(v))
+		v = 0;
+	return v;
+}
+
+/**
+ * @brief 开始一段测量
+ */
+void counter_start(struct counter *c)
+{
+	c->a0 = nalloc;
+	c->m0 = perf_read();
+	c->t0 = now_ns();
+}
+
+/**
+ * @brief 结束一段测量并累计
+ * @param c 测量
+ * @param ops 本段的操作次数
+ */
+void counter_stop(struct counter *c, long ops)
+{
+	uint64_t t = now_ns();
+
+	c->misses += perf_read() - c->m0;
+	c->ns += t - c->t0;
+	c->allocs += nalloc - c->a0;
+	c->ops += ops;
+}
+
+/**
+ * @brief 输出一项测量结果
+ * @param policy 调度算法名
+ * @param op 操作名
+ * @param depth 排队作业数
+ * @param c 测量
+ */
+void report(const char *policy, const char *op, int depth, const struct counter *c)
+{
+	double ops = c->ops ? c->ops : 1;
+
+	if (json) {
+		printf("{\"policy\":\"%s\",\"op\":\"%s\",\"depth\":%d,\"ops\":%ld,"
+			"\"ns_per_op\":%.1f,\"allocs_per_op\":%.4f,",
+			policy, op, depth, c->ops, c->ns / ops, c->allocs / ops);
+		if (perffd >= 0)
+			printf("\"misses_per_op\":%.2f}\n", c->misses / ops);
+		else
+			printf("\"misses_per_op\":null}\n");
+	} else {
+		printf("%s\t%s\t%d\t%ld\t%.1f\t%.4f\t", policy, op, depth, c->ops,
+			c->ns / ops, c->allocs / ops);
+		if (perffd >= 0)
+			printf("%.2f\n", c->misses / ops);
+		else
+			printf("-\n");
+	}
+	fflush(stdout);
+}
+
+/**
+ * @brief 为运行中的作业记账，并更新调度时钟
+ * @param elapsed 距上次调度经过的时间（单位：毫秒）
+ * @details 与调度器的updateall()相同，只是按墙上时间记账，不读取作业进程的CPU时间
+ */
+void updateall(int elapsed)
+{
+	struct runslot *sl;
+
+	for (sl = slots; sl < slots + nslot; sl++) {
+		if (sl->current) {
+			sl->current->job->run_time += elapsed;
+			sl->current->job->remaining_time -= elapsed;
+		}
+	}
+	clock_ms += elapsed;
+	jobage();
+}
+
+/**
+ * @brief 作业切换函数
+ * @details 与调度器的jobswitch()相同的状态转换，只是不操作进程
+ */
+void jobswitch()
+{
+	if (cur->next == NULL || cur->next == cur->current) {
+		cur->next = NULL;
+		return;
+	}
+	if (cur->current)
+		cur->current->job->state = READY;
+	cur->current = cur->next;
+	cur->next = NULL;
+	cur->current->job->state = RUNNING;
+}
+
+void jobmigrate(struct jobinfo *job)
+{
+	(void)job;
+}
+
+void jobpublish(const struct jobinfo *job)
+{
+	(void)job;
+}
+
+/**
+ * @brief 入队，与调度器的do_enq()相同的步骤，不打印
+ * @param duration 预计运行时间
+ * @param defpri 默认优先级
+ */
+void bench_enq(int duration, int defpri)
+{
+	struct jobinfo *job = job_alloc();
+	char **arglist;
+
+	job->jid = ++jobid;
+	job->defpri = defpri;
+	job->ownerid = 0;
+	job->duration = duration;
+	job->pidfd = -1;
+	job->cgroup = 0;
+	job->cpu_ns = 0;
+	job->cpufd = -1;
+	job->tabrow = -1;
+	arglist = blob_alloc(sizeof(char*) * 2 + 10);
+	arglist[0] = strcpy((char*)(arglist + 2), "/bin/true");
+	arglist[1] = NULL;
+	job->cmdarg = arglist;
+	job->pid = 0;
+	jobadmit(job, slot_pick());
+	queue_push(&jobs, &job->node);
+	index_insert(&jidindex, job->jid, job);
+	live[nlive++] = job->jid;
+}
+
+/**
+ * @brief 出队，与调度器的do_deq()和jobfree()相同的步骤，没有进程要终止
+ * @param jid 作业ID
+ */
+void bench_deq(int jid)
+{
+	struct jobinfo *job = index_find(&jidindex, jid);
+	struct runslot *sl = &slots[job->slot];
+
+	if (&job->node == sl->current)
+		sl->current = NULL;
+	else
+		rq_remove(sl, &job->node);
+	queue_remove(&jobs, &job->node);
+	if (job->curpri < 3)
+		wheel_remove(&agewheel, job);
+	index_remove(&jidindex, job->jid);
+	blob_release(job->cmdarg);
+	job_release(job);
+}
+
+/**
+ * @brief 随机取出一个排队作业的ID
+ */
+int pick_live()
+{
+	int i = rand() % nlive, jid = live[i];
+
+	live[i] = live[--nlive];
+	return jid;
+}
+
+/**
+ * @brief 线性扫描选择，与堆实现之前的SJF选择方法相同
+ * @return 预计运行时间最短的作业
+ */
+struct jobinfo *scan_SJF()
+{
+	struct jobinfo *selected = NULL;
+	struct waitqueue *p;
+
+	for (p = jobs.head; p != NULL; p = p->next)
+		if (selected == NULL || p->job->duration < selected->duration ||
+		    (p->job->duration == selected->duration &&
+		     p->job->jid < selected->jid))
+			selected = p->job;
+	return selected;
+}
+
+/**
+ * @brief 测量一种调度算法在一种队列长度下的各项开销
+ * @param p 调度算法
+ * @param depth 排队作业数
+ */
+void bench_policy(const struct policy *p, int depth)
+{
+	struct counter c;
+	struct waitqueue *w;
+	uint64_t deadline;
+	int i, n, *victims;
+	long ops;
+
+	// 每项测量从相同的初始状态开始，执行槽的就绪队列在上一项结束时已经为空
+	policy_use(p);
+	memset(&agewheel, 0, sizeof(agewheel));
+	clock_ms = 0;
+	mlfq_next_boost = MLFQ_BOOST_MS;
+	for (i = 0; i < depth; i++)
+		bench_enq(rand() % 65536, rand() % 4);
+	dispatch(slots);
+
+	// 调度时钟：记账、老化，运行中的作业放回并重新选择
+	memset(&c, 0, sizeof(c));
+	deadline = now_ns() + BUDGET_NS;
+	counter_start(&c);
+	for (ops = 0; ops < NOPS && (ops % 256 != 0 || now_ns() < deadline); ops++)
+		schedule(QUANTUM);
+	counter_stop(&c, ops);
+	report(p->name, "tick", depth, &c);
+
+	// 作业结束后的选择：选出下一个作业，测量后放回以保持队列长度
+	memset(&c, 0, sizeof(c));
+	deadline = now_ns() + BUDGET_NS;
+	counter_start(&c);
+	for (ops = 0; ops < NOPS && (ops % 256 != 0 || now_ns() < deadline); ops++) {
+		w = rq_select(slots);
+		rq_insert(slots, w, 0);
+	}
+	counter_stop(&c, ops);
+	report(p->name, "select", depth, &c);
+
+	// 入队和出队：每批入队n个新作业，再随机出队n个作业，队列长度保持在depth到depth+n之间
+	n = depth < NBATCH ? depth : NBATCH;
+	if ((victims = malloc(sizeof(*victims) * n)) == NULL)
+		error_sys("malloc failed");
+	{
+		struct counter enq, deq;
+
+		memset(&enq, 0, sizeof(enq));
+		memset(&deq, 0, sizeof(deq));
+		deadline = now_ns() + BUDGET_NS;
+		while (enq.ops < NOPS && now_ns() < deadline) {
+			counter_start(&enq);
+			for (i = 0; i < n; i++)
+				bench_enq(rand() % 65536, rand() % 4);
+			counter_stop(&enq, n);
+
+			for (i = 0; i < n; i++)
+				victims[i] = pick_live();
+			counter_start(&deq);
+			for (i = 0; i < n; i++)
+				bench_deq(victims[i]);
+			counter_stop(&deq, n);
+		}
+		report(p->name, "enq", depth, &enq);
+		report(p->name, "deq", depth, &deq);
+	}
+	free(victims);
+
+	// SJF的对照：逐个扫描全部作业
+	if (p->select == jobselect_SJF) {
+		memset(&c, 0, sizeof(c));
+		n = depth > NOPS / NSCAN ? NSCAN : NOPS;
+		counter_start(&c);
+		for (i = 0; i < n; i++)
+			sink = scan_SJF()->jid;
+		counter_stop(&c, n);
+		report(p->name, "scan", depth, &c);
+	}
+
+	// 清空队列
+	while (nlive > 0)
+		bench_deq(pick_live());
+}
+
+/**
+ * @brief 主函数
+ * @param argc 命令行参数数量
+ * @param argv 命令行参数数组
+ * @return 0表示成功
+ */
+int main(int argc, char *argv[])
+{
+	char *only = NULL;
+	int i, c, depth, maxdepth = MAXDEPTH;
+
+	while ((c = getopt(argc, argv, "jp:")) != -1) {
+		switch (c) {
+		case 'j':  // 输出JSON，每行一项
+			json = 1;
+			break;
+		case 'p':  // 只测量一种调度算法
+			only = optarg;
+			break;
+		default:
+			printf("Usage: bench [-j] [-p policy] [maxdepth]\n");
+			return 1;
+		}
+	}
+	if (optind < argc)
+		maxdepth = atoi(argv[optind]);
+
+	srand(1);
+	perffd = perf_open();
+	slots_init(1);
+	if ((live = malloc(sizeof(*live) * ((size_t)maxdepth + NBATCH))) == NULL)
+		error_sys("malloc failed");
+
+	if (!json)
+		printf("policy\top\tdepth\tops\tns/op\tallocs/op\tmisses/op\n");
+	for (i = 0; i < NPOLICY; i++) {
+		if (only != NULL && strcasecmp(only, policies[i].name) != 0)
+			continue;
+		for (depth = 10; depth <= maxdepth; depth *= 10)
+			bench_policy(&policies[i], depth);
+	}
+	return 0;
+}
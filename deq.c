@@ -1,16 +1,22 @@
 /**
  * @file deq.c
  * @brief 作业出队命令实现
- * @details 实现从调度器中移除指定作业的功能
+ * @details 实现从调度器中移除指定作业的功能。优先通过控制套接字发送并报告结果，
+ *          调度器没有控制套接字时写入FIFO
  */
 
 #include <unistd.h>      // 提供系统调用接口
+#include <stdio.h>       // 标准输入输出
+#include <stdlib.h>      // 字符串转换
 #include <string.h>      // 字符串处理函数
 #include <sys/types.h>   // 基本系统数据类型
 #include <sys/stat.h>    // 文件状态
 #include <sys/ipc.h>     // IPC机制
 #include <fcntl.h>       // 文件控制
+#include <errno.h>       // 错误码
+#include <sys/socket.h>  // 控制套接字
 #include "job.h"         // 作业相关定义
+#include "proto.h"       // 命令协议
 
 /**
  * @brief 显示命令使用说明
@@ -31,7 +37,11 @@ void usage()
  */
 int main(int argc,char *argv[])
 {
-	struct jobcmd deqcmd;  // 定义作业命令结构体
+	struct deqbody deqcmd; // 出队消息体
+	char buf[sizeof(struct msghead) + sizeof(struct deqbody)];  // 编码后的帧
+	char reply[PROTO_MAXMSG];   // 应答
+	struct replybody rep;
+	char *end;             // 作业ID解析结束位置
 	int fd;                // 文件描述符
 
 	// 检查命令行参数数量是否正确
@@ -41,22 +51,43 @@ int main(int argc,char *argv[])
 		return 1;
 	}
 
-	// 初始化作业命令结构体
-	deqcmd.type = DEQ;           // 设置命令类型为出队
-	deqcmd.defpri = 0;           // 设置默认优先级
+	// 初始化出队消息
 	deqcmd.owner = getuid();     // 获取当前用户ID作为命令所有者
-	deqcmd.argnum = 1;           // 设置参数数量为1
+	deqcmd.jid = strtol(argv[1], &end, 10);
+	if (*argv[1] == '\0' || *end != '\0' || deqcmd.jid <= 0) {
+		printf("invalid jid: %s\n", argv[1]);
+		return 1;
+	}
+	printf("jid %d\n",deqcmd.jid);
 
-	// 将作业ID复制到命令数据中
-	strcpy(deqcmd.data,*++argv);
-	printf("jid %s\n",deqcmd.data);
+	// 帧头后接出队消息体
+	memcpy(buf + proto_head(buf, MSG_DEQ, sizeof(deqcmd)), &deqcmd, sizeof(deqcmd));
+
+	// 经控制套接字发送并等待结果
+	if ((fd = proto_connect()) >= 0) {
+		while (send(fd, buf, sizeof(buf), MSG_NOSIGNAL) < 0)
+			if (errno != EINTR)
+				error_sys("deq send failed");
+		if (proto_recvreply(fd, reply, sizeof(reply), &rep) < 0) {
+			printf("deq: no reply from scheduler\n");
+			return 1;
+		}
+		close(fd);
+		if (rep.status != 0) {
+			printf("deq failed: jid %d: %s\n", deqcmd.jid,
+				rep.status == ESRCH ? "no such job" : strerror(rep.status));
+			return 1;
+		}
+		printf("job %d terminated\n", deqcmd.jid);
+		return 0;
+	}
 
 	// 打开FIFO管道进行通信
 	if ((fd = open(FIFO,O_WRONLY)) < 0)
 		error_sys("deq open fifo failed");
 
 	// 将命令写入FIFO管道
-	if (write(fd,&deqcmd,DATALEN)< 0)
+	if (proto_send(fd, buf, sizeof(buf)) < 0)
 		error_sys("deq write failed");
 
 	// 关闭FIFO管道
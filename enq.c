@@ -1,7 +1,9 @@
 /**
  * @file enq.c
  * @brief 作业入队命令实现
- * @details 实现向调度器提交新作业的功能，支持设置作业优先级和持续时间
+ * @details 实现向调度器提交新作业的功能，支持设置作业优先级和持续时间，
+ *          也可以从文件读入大量作业，合并成批量入队消息一次提交。
+ *          优先通过控制套接字提交并打印分配的作业ID，调度器没有控制套接字时写入FIFO
  */
 
 #include <unistd.h>      // 提供系统调用接口
@@ -10,10 +12,15 @@
 #include <sys/stat.h>    // 文件状态
 #include <sys/ipc.h>     // IPC机制
 #include <fcntl.h>       // 文件控制
+#include <errno.h>       // 错误码
+#include <sys/socket.h>  // 控制套接字
 #include "job.h"         // 作业相关定义
+#include "proto.h"       // 命令协议
 #include <stdio.h>       // 标准输入输出
 #include <stdlib.h>      // 动态内存分配
 
+#define MAXARGS 256      // 批量文件中每行最多的参数个数
+
 /**
  * @brief 显示命令使用说明
  * @details 当用户输入参数不正确时调用此函数，显示完整的命令格式和参数说明
@@ -21,10 +28,194 @@
 void usage()
 {
 	printf("Usage:  enq [-p num] [-d dur] e_file args\n"
+		"        enq -f jobfile\n"
 		"\t-p num\t\t specify the job priority\n"    // 指定作业优先级
-        "\t-d dur\t\t specify the job duration\n"    // 指定作业持续时间
+        "\t-d dur\t\t specify the job duration in milliseconds (0-65535)\n"    // 指定作业持续时间（毫秒）
         "\te_file\t\t the absolute path of the exefile\n"  // 可执行文件的绝对路径
-		"\targs\t\t the args passed to the e_file\n");     // 传递给可执行文件的参数
+		"\targs\t\t the args passed to the e_file\n"       // 传递给可执行文件的参数
+		"\t-f jobfile\t submit every line of jobfile as one job in a single batch,\n"
+		"\t\t\t each line written as [-p num] [-d dur] e_file args\n");  // 批量提交
+}
+
+/**
+ * @brief 解析一个作业的选项和参数
+ * @param argc 参数数量
+ * @param argvp 参数数组，返回时指向可执行文件
+ * @param p 输出的优先级
+ * @param d 输出的持续时间
+ * @return 剩余参数（可执行文件及其参数）的个数，-1表示出错
+ */
+int parsejob(int argc, char ***argvp, int *p, int *d)
+{
+	char **argv = *argvp;
+
+	*p = 0;
+	*d = 0;
+
+	// 解析命令行选项
+	while (argc > 0 && argv[0][0] == '-') {
+		if (argc < 2) {
+			usage();
+			return -1;
+		}
+		switch (argv[0][1]) {
+		case 'p':  // 处理优先级选项
+			*p = atoi(argv[1]);
+			break;
+		case 'd':  // 处理持续时间选项
+			*d = atoi(argv[1]);
+			break;
+		default:   // 处理非法选项
+			printf("Illegal option %c\n", argv[0][1]);
+			return -1;
+		}
+		argv += 2;
+		argc -= 2;
+	}
+	*argvp = argv;
+
+	// 验证优先级范围（0-3）
+	if (*p < 0 || *p > 3) {
+		printf("invalid priority: must between 0 and 3\n");
+		return -1;
+	}
+    // 验证持续时间范围（0-65535毫秒）
+    if (*d < 0 || *d > 65535) {
+		printf("invalid duration: must between 0 and 65535 ms\n");
+		return -1;
+	}
+	if (argc == 0) {
+		usage();
+		return -1;
+	}
+	return argc;
+}
+
+/**
+ * @brief 读入作业文件并编码为批量入队帧
+ * @param path 作业文件路径
+ * @param len 输出的帧总长度
+ * @param maxbody 单帧消息体的长度上限
+ * @return 帧数据，失败时返回NULL
+ * @details 记录数超过单帧上限时自动拆成多帧，依次排列在返回的缓冲区中。
+ *          行的长度不限；参数超过MAXARGS个的行视为错误，不会被截断后提交
+ */
+char *readbatch(const char *path, size_t *len, size_t maxbody)
+{
+	FILE *fp;
+	char *line = NULL, *args[MAXARGS], **argv, *tok;
+	char *buf = NULL;
+	size_t linecap = 0, cap = 0, frame = 0, need;
+	uint32_t count = 0;
+	int argc, p, d, lineno = 0;
+
+	if ((fp = fopen(path, "r")) == NULL) {
+		perror(path);
+		return NULL;
+	}
+
+	*len = 0;
+	while (getline(&line, &linecap, fp) != -1) {
+		lineno++;
+		argc = 0;
+		for (tok = strtok(line, " \t\r\n"); tok != NULL && argc < MAXARGS;
+		     tok = strtok(NULL, " \t\r\n"))
+			args[argc++] = tok;
+		if (argc == 0 || args[0][0] == '#')  // 跳过空行和注释
+			continue;
+
+		argv = args;
+		if (tok != NULL) {
+			printf("%s:%d: too many arguments (at most %d)\n", path, lineno, MAXARGS);
+			argc = -1;
+		} else {
+			argc = parsejob(argc, &argv, &p, &d);
+		}
+		if (argc < 0) {
+			printf("%s:%d: bad job line\n", path, lineno);
+			fclose(fp);
+			free(line);
+			free(buf);
+			return NULL;
+		}
+
+		// 当前帧放不下时结束它并开始新的一帧
+		need = proto_enqsize(argc, argv);
+		if (count > 0 && *len - frame - sizeof(struct msghead) + need > maxbody) {
+			proto_head(buf + frame, MSG_ENQBATCH, *len - frame - sizeof(struct msghead));
+			memcpy(buf + frame + sizeof(struct msghead), &count, sizeof(count));
+			frame = *len;
+			count = 0;
+		}
+		if (count == 0)
+			need += sizeof(struct msghead) + sizeof(count);
+
+		if (*len + need > cap) {
+			cap = (*len + need) * 2;
+			if ((buf = realloc(buf, cap)) == NULL)
+				error_sys("realloc failed");
+		}
+		if (count == 0)
+			*len += sizeof(struct msghead) + sizeof(count);
+		*len += proto_putenq(buf + *len, getuid(), p, d, argc, argv);
+		count++;
+	}
+	fclose(fp);
+	free(line);
+
+	if (count == 0) {
+		printf("%s: no jobs\n", path);
+		free(buf);
+		return NULL;
+	}
+	proto_head(buf + frame, MSG_ENQBATCH, *len - frame - sizeof(struct msghead));
+	memcpy(buf + frame + sizeof(struct msghead), &count, sizeof(count));
+	return buf;
+}
+
+/**
+ * @brief 通过控制套接字提交帧并打印应答
+ * @param fd 控制套接字
+ * @param buf 依次排列的若干帧
+ * @param len 数据长度
+ * @return 0表示全部成功，-1表示有作业未能入队
+ * @details 不等上一个应答就发送下一帧，最多PROTO_WINDOW个请求未收到应答
+ */
+int submit(int fd, const char *buf, size_t len)
+{
+	char reply[PROTO_MAXMSG];
+	struct replybody rep;
+	struct msghead head;
+	size_t off = 0, n;
+	int inflight = 0, ret = 0;
+
+	while (off < len || inflight > 0) {
+		if (off < len && inflight < PROTO_WINDOW) {
+			proto_parsehead(buf + off, len - off, &head);
+			n = sizeof(head) + head.len;
+			while (send(fd, buf + off, n, MSG_NOSIGNAL) < 0)
+				if (errno != EINTR)
+					error_sys("enq send failed");
+			off += n;
+			inflight++;
+			continue;
+		}
+
+		if (proto_recvreply(fd, reply, sizeof(reply), &rep) < 0) {
+			printf("enq: no reply from scheduler\n");
+			return -1;
+		}
+		inflight--;
+		if (rep.count == 1)
+			printf("jid %d\n", rep.jid);
+		else if (rep.count > 1)
+			printf("jid %d-%d\n", rep.jid, rep.jid + rep.count - 1);
+		if (rep.status != 0) {
+			printf("enq failed: %s\n", strerror(rep.status));
+			ret = -1;
+		}
+	}
+	return ret;
 }
 
 /**
@@ -36,10 +227,13 @@ void usage()
  */
 int main(int argc,char *argv[])
 {
-	int	p = 0, d = 0;    // p: 优先级, d: 持续时间
+	int	p, d;            // p: 优先级, d: 持续时间
 	int	fd;              // FIFO文件描述符
-	char	c, *offset;    // c: 选项字符, offset: 数据缓冲区偏移量
-	struct jobcmd enqcmd; // 作业命令结构体
+	int	sock;            // 控制套接字
+	char	*buf;          // 编码后的帧
+	size_t	len;           // 帧长度
+	int	ret;
+	int	batch;           // 是否从文件批量提交
 
 	// 检查是否有参数
 	if (argc == 1) {
@@ -47,69 +241,57 @@ int main(int argc,char *argv[])
 		return 1;
 	}
 
-	// 解析命令行选项
-	while (--argc > 0 && (*++argv)[0] == '-') {
-		while ((c = *++argv[0]))
-			switch (c) {
-			case 'p':  // 处理优先级选项
-				p = atoi(*(++argv));
-				argc--;
-				break;
-            case 'd':  // 处理持续时间选项
-				d = atoi(*(++argv));
-				argc--;
-				break;
-			default:   // 处理非法选项
-				printf("Illegal option %c\n",c);
-				return 1;
-			}
-	}
-
-	// 验证优先级范围（0-3）
-	if (p < 0 || p > 3) {
-		printf("invalid priority: must between 0 and 3\n");
-		return 1;
-	}
-    // 验证持续时间范围（0-65535）
-    if (d < 0 || d > 65535) {
-		printf("invalid duration: must between 0 and 65535\n");
-		return 1;
-	}
+	sock = proto_connect();
+	batch = strcmp(argv[1], "-f") == 0;
 
-	// 初始化作业命令结构体
-	enqcmd.type = ENQ;           // 设置命令类型为入队
-	enqcmd.defpri = p;           // 设置作业优先级
-    enqcmd.duration = d;         // 设置作业持续时间
-	enqcmd.owner = getuid();     // 获取当前用户ID作为作业所有者
-	enqcmd.argnum = argc;        // 设置参数数量
-	offset = enqcmd.data;        // 初始化数据缓冲区偏移量
-
-	// 将命令行参数复制到命令数据中，用冒号分隔
-	while (argc-- > 0) {
-		strcpy(offset,*argv);    // 复制参数
-		strcat(offset,":");      // 添加分隔符
-		offset = offset + strlen(*argv) + 1;  // 更新偏移量
+	if (batch) {
+		// 批量提交，经控制套接字时每帧不超过一条消息的上限
+		if (argc != 3) {
+			usage();
+			return 1;
+		}
+		if ((buf = readbatch(argv[2], &len, sock >= 0 ?
+		    PROTO_MAXMSG - sizeof(struct msghead) : PROTO_MAXBODY)) == NULL)
+			return 1;
+	} else {
+		// 单个作业：帧头后接一条入队记录
 		argv++;
+		if ((argc = parsejob(argc - 1, &argv, &p, &d)) < 0)
+			return 1;
+		len = sizeof(struct msghead) + proto_enqsize(argc, argv);
+		if (len - sizeof(struct msghead) > PROTO_MAXBODY) {
+			printf("job arguments too long\n");
+			return 1;
+		}
+		if ((buf = malloc(len)) == NULL)
+			error_sys("malloc failed");
+		proto_putenq(buf + proto_head(buf, MSG_ENQ, len - sizeof(struct msghead)),
+			getuid(), p, d, argc, argv);
 	}
 
 #ifdef DEBUG
 	// 调试信息输出
-	printf("enqcmd cmdtype\t%d\n"
-		"enqcmd owner\t%d\n"
-		"enqcmd defpri\t%d\n"
-		"enqcmd data\t%s\n",
-		enqcmd.type, enqcmd.owner, enqcmd.defpri, enqcmd.data);
+	printf("enq frame length\t%zu\n", len);
 #endif
 
+	// 经控制套接字提交，单个作业的参数超过消息上限时改用FIFO
+	if (sock >= 0 && (batch || len <= PROTO_MAXMSG)) {
+		ret = submit(sock, buf, len);
+		close(sock);
+		free(buf);
+		return ret < 0 ? 1 : 0;
+	}
+
 	// 打开FIFO管道进行通信
 	if ((fd = open(FIFO,O_WRONLY)) < 0)
 		error_sys("enq open fifo failed");
 
 	// 将命令写入FIFO管道
-	if (write(fd,&enqcmd,DATALEN)< 0)
+	if (proto_send(fd, buf, len) < 0)
 		error_sys("enq write failed");
 
 	// 关闭FIFO管道
 	close(fd);
+	free(buf);
 	return 0;
 }
@@ -0,0 +1,196 @@
+/**
+ * @file fifotest.c
+ * @brief FIFO并发写入测试
+ * @details 若干进程同时向同一个FIFO写帧：一部分写不超过PIPE_BUF的单条入队帧，一部分写
+ *          远大于管道容量、必须分多次写入的批量入队帧。读者按调度器的方式（见do_ingest）
+ *          逐帧解析，任何一帧被其他客户端的数据插入都会使帧头或入队记录无法解析。
+ *          全部帧完整收到时输出PASS并返回0，否则输出FAIL并返回1
+ */
+
+#include <stdio.h>       // 标准输入输出
+#include <stdlib.h>      // 动态内存分配
+#include <stdint.h>      // 定长整数类型
+#include <string.h>      // 字符串处理
+#include <unistd.h>      // 系统调用接口
+#include <fcntl.h>       // 文件控制
+#include <limits.h>      // PIPE_BUF
+#include <sys/stat.h>    // mkfifo
+#include <sys/wait.h>    // 回收写者
+#include "job.h"         // 作业相关定义
+#include "proto.h"       // 命令协议
+
+#define BATCH_JOBS 2000         // 每个批量帧中的作业数，约100KB，超过管道容量
+
+int nsmall = 16;            // 写单条帧的进程数
+int nlarge = 4;             // 写批量帧的进程数
+int nframes = 2000;         // 每个进程写的帧数
+
+/**
+ * @brief 打印使用说明
+ */
+void usage()
+{
+	printf("Usage: fifotest [-s small] [-l large] [-n frames]\n"
+		"  -s small   processes writing single-job frames, default 16\n"
+		"  -l large   processes writing batch frames larger than the pipe, default 4\n"
+		"  -n frames  frames written by each process, default 2000\n");
+}
+
+/**
+ * @brief 写者进程
+ * @param path FIFO路径
+ * @param id 写者序号，作为作业的所有者ID
+ * @param large 是否写批量帧
+ * @param keep 父进程的保活写端，打开自己的写端后关闭
+ */
+void writer(const char *path, int id, int large, int keep)
+{
+	char *argv[] = { "/bin/true", "fifotest", NULL };
+	char *buf, *q;
+	size_t rec = proto_enqsize(2, argv), len;
+	uint32_t count = large ? BATCH_JOBS : 1;
+	int fd, i, j;
+
+	if ((fd = open(path, O_WRONLY)) < 0)
+		error_sys("open fifo failed");
+	close(keep);
+	len = sizeof(struct msghead) + (large ? sizeof(count) : 0) + rec * count;
+	if ((buf = malloc(len)) == NULL)
+		error_sys("malloc failed");
+
+	q = buf + proto_head(buf, large ? MSG_ENQBATCH : MSG_ENQ, len - sizeof(struct msghead));
+	if (large) {
+		memcpy(q, &count, sizeof(count));
+		q += sizeof(count);
+	}
+	for (j = 0; j < (int)count; j++)
+		q += proto_putenq(q, id, j % 4, 1, 2, argv);
+
+	for (i = 0; i < nframes; i++)
+		if (proto_send(fd, buf, len) < 0)
+			error_sys("write fifo failed");
+	exit(0);
+}
+
+/**
+ * @brief 解析一帧
+ * @param head 帧头
+ * @param body 消息体
+ * @return 帧中的作业数，-1表示帧已损坏
+ */
+long parseframe(const struct msghead *head, const char *body)
+{
+	struct jobcmd cmd;
+	const char *end = body + head->len;
+	uint32_t count, i;
+	long n;
+
+	if (head->type == MSG_ENQ)
+		return proto_parseenq(body, head->len, &cmd) == (long)head->len ? 1 : -1;
+	if (head->type != MSG_ENQBATCH || head->len < sizeof(count))
+		return -1;
+	memcpy(&count, body, sizeof(count));
+	body += sizeof(count);
+	for (i = 0; i < count; i++) {
+		if ((n = proto_parseenq(body, end - body, &cmd)) < 0)
+			return -1;
+		body += n;
+	}
+	return body == end ? (long)count : -1;
+}
+
+int main(int argc, char *argv[])
+{
+	struct msghead head;
+	char path[64], *buf;
+	size_t cap = 1 << 20, len = 0, off;
+	long frames = 0, jobs = 0, bad = 0, n;
+	ssize_t count;
+	int c, fd, keep = -1, i, ret, status, failed = 0;
+
+	while ((c = getopt(argc, argv, "s:l:n:")) != -1) {
+		switch (c) {
+		case 's':
+			nsmall = atoi(optarg);
+			break;
+		case 'l':
+			nlarge = atoi(optarg);
+			break;
+		case 'n':
+			nframes = atoi(optarg);
+			break;
+		default:
+			usage();
+			return 1;
+		}
+	}
+	if (nsmall < 0 || nlarge < 0 || nsmall + nlarge == 0 || nframes < 1) {
+		usage();
+		return 1;
+	}
+
+	snprintf(path, sizeof(path), "/tmp/fifotest.%d", (int)getpid());
+	unlink(path);
+	if (mkfifo(path, 0600) < 0)
+		error_sys("mkfifo failed");
+	// 写者继承保活写端，直到打开自己的写端后才关闭，先结束的写者不会让读者提前读到文件结束
+	if ((fd = open(path, O_RDONLY|O_NONBLOCK)) < 0 || (keep = open(path, O_WRONLY)) < 0)
+		error_sys("open fifo failed");
+	fcntl(fd, F_SETFL, 0);
+	for (i = 0; i < nsmall + nlarge; i++) {
+		switch (fork()) {
+		case -1:
+			error_sys("fork failed");
+			break;
+		case 0:
+			close(fd);
+			writer(path, i, i >= nsmall, keep);
+			break;
+		}
+	}
+	close(keep);
+
+	// 与调度器一样逐帧解析，写者全部关闭后读到文件结束
+	if ((buf = malloc(cap)) == NULL)
+		error_sys("malloc failed");
+	while ((count = read(fd, buf + len, cap - len)) > 0) {
+		len += count;
+		for (off = 0; ; off += sizeof(head) + head.len) {
+			ret = proto_parsehead(buf + off, len - off, &head);
+			if (ret < 0) {   // 无法重新同步，与调度器一样丢弃缓冲区
+				bad++;
+				off = len;
+				break;
+			}
+			if (ret == 0 || len - off < sizeof(head) + head.len)
+				break;
+			if ((n = parseframe(&head, buf + off + sizeof(head))) < 0) {
+				bad++;
+				continue;
+			}
+			frames++;
+			jobs += n;
+		}
+		memmove(buf, buf + off, len - off);
+		len -= off;
+		if (len == cap) {
+			bad++;
+			len = 0;
+		}
+	}
+	close(fd);
+	unlink(path);
+	while (wait(&status) > 0)
+		if (!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+			failed++;
+
+	printf("frames %ld/%ld, jobs %ld/%ld, corrupted %ld, writers failed %d\n",
+		frames, (long)(nsmall + nlarge) * nframes,
+		jobs, (long)nsmall * nframes + (long)nlarge * nframes * BATCH_JOBS, bad, failed);
+	if (bad > 0 || failed > 0 || len > 0 || frames != (long)(nsmall + nlarge) * nframes) {
+		printf("FAIL\n");
+		return 1;
+	}
+	printf("PASS\n");
+	return 0;
+}
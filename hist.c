@@ -0,0 +1,78 @@
+/**
+ * @file hist.c
+ * @brief HDR直方图实现
+ */
+
+#include "hist.h"       // 直方图定义
+
+/**
+ * @brief 值所在的桶
+ * @param v 值
+ * @return 桶号
+ */
+static int hist_bucket(uint64_t v)
+{
+	int shift;
+
+	if (v < HIST_SUB)
+		return v;
+	if (v >> HIST_MAXBITS)
+		return HIST_BUCKETS - 1;
+	// 最高位在第k位时右移k-HIST_SUBBITS+1位，保留HIST_SUBBITS位有效数字
+	shift = 63 - __builtin_clzll(v) - HIST_SUBBITS + 1;
+	return HIST_SUB + (shift - 1) * (HIST_SUB / 2) + (int)(v >> shift) - HIST_SUB / 2;
+}
+
+/**
+ * @brief 桶中值的代表值
+ * @param b 桶号
+ * @return 桶覆盖范围的中点
+ */
+static uint64_t hist_value(int b)
+{
+	int shift;
+
+	if (b < HIST_SUB)
+		return b;
+	shift = (b - HIST_SUB) / (HIST_SUB / 2) + 1;
+	return ((uint64_t)((b - HIST_SUB) % (HIST_SUB / 2) + HIST_SUB / 2) << shift) +
+		((1ULL << shift) >> 1);
+}
+
+/**
+ * @brief 记录一个值
+ * @param h 直方图
+ * @param v 值
+ */
+void hist_record(struct hist *h, uint64_t v)
+{
+	h->counts[hist_bucket(v)]++;
+	h->count++;
+	if (v > h->max)
+		h->max = v;
+}
+
+/**
+ * @brief 求百分位
+ * @param h 直方图
+ * @param q 分位数（0-1）
+ * @return 至少有q比例的值不大于的那个桶的代表值，不超过最大值；没有记录时返回0
+ */
+uint64_t hist_quantile(const struct hist *h, double q)
+{
+	uint64_t rank, seen = 0, v;
+	int b;
+
+	if (h->count == 0)
+		return 0;
+	rank = (uint64_t)(q * h->count);
+	if (rank >= h->count)
+		rank = h->count - 1;
+	for (b = 0; b < HIST_BUCKETS; b++) {
+		seen += h->counts[b];
+		if (seen > rank)
+			break;
+	}
+	v = hist_value(b);
+	return v < h->max ? v : h->max;
+}
@@ -0,0 +1,28 @@
+/**
+ * @file hist.h
+ * @brief HDR直方图
+ * @details 对数线性分桶：小于2^HIST_SUBBITS的值每个值一个桶，更大的值在每个2的幂区间内
+ *          均分为2^(HIST_SUBBITS-1)个桶，相对误差不超过1/64。桶数固定，记录是常数时间，
+ *          求任意百分位只需扫描一遍桶数组，与记录过的值的个数无关
+ */
+
+#ifndef _HIST_H
+#define _HIST_H
+
+#include <stdint.h>
+
+#define HIST_SUBBITS 7                          // 子桶位数
+#define HIST_SUB (1 << HIST_SUBBITS)            // 第一个区间的桶数
+#define HIST_MAXBITS 48                         // 值的上限为2^48，更大的值记入最后一个桶
+#define HIST_BUCKETS (HIST_SUB + (HIST_MAXBITS - HIST_SUBBITS) * (HIST_SUB / 2))
+
+struct hist {
+    uint64_t count;                 // 记录的值的个数
+    uint64_t max;                   // 最大值
+    uint64_t counts[HIST_BUCKETS];  // 各桶的计数
+};
+
+void hist_record(struct hist *h, uint64_t v);
+uint64_t hist_quantile(const struct hist *h, double q);
+
+#endif
@@ -2,10 +2,10 @@
 #define _JOB_H
 
 #include <sys/types.h>
+#include <stdint.h>
 #include <time.h>
 #include <signal.h>
 
-#define DATALEN 1024
 #define BUFLEN 1024
 #define FIFO "/tmp/jobfifo"
 
@@ -19,6 +19,22 @@
 #define DEQ 2
 #define STAT 3
 
+struct jobinfo;
+
+// 作业队列节点，嵌入在作业结构体中
+struct waitqueue {
+    struct jobinfo *job;    // 作业信息
+    struct waitqueue *prev; // 前一个节点
+    struct waitqueue *next; // 下一个节点
+};
+
+// 作业队列：带尾指针的双向链表，入队、出队和任意位置删除都是常数时间
+struct jobqueue {
+    struct waitqueue *head; // 队首
+    struct waitqueue *tail; // 队尾
+    int count;              // 队列中的作业数
+};
+
 // 作业信息结构体
 struct jobinfo {
     int jid;                // 作业ID
@@ -26,45 +42,57 @@ struct jobinfo {
     int ownerid;            // 所有者ID
     int defpri;             // 默认优先级
     int curpri;             // 当前优先级
-    int priority;           // 多级反馈队列中的优先级
+    int priority;           // 多级反馈队列中的级别，0最高
     int state;              // 作业状态
-    int run_time;           // 运行时间
-    int wait_time;          // 等待时间
+    int run_time;           // 已使用的CPU时间（单位：毫秒）
+    uint64_t cpu_ns;        // 已使用的CPU时间（单位：纳秒），run_time由它换算
+    clockid_t cpuclock;     // 作业进程的CPU时钟
+    int cpufd;              // 作业cgroup的cpu.stat，-1表示没有
+    int tabrow;             // 在共享内存作业表中的行号，-1表示未发布
+    long enq_time;          // 入队时的调度时钟（单位：毫秒），老化由它推算
+    long wait_base;         // 等待中作业的等待时间为调度时钟减去它
+    long wait_time;         // 运行中作业此前在就绪队列中等待的总时间（单位：毫秒）
+    long promote_at;        // 下次老化提升优先级的调度时钟（单位：毫秒）
     int wait_time_hrrf;     // HRRF等待时间
     time_t create_time;     // 创建时间
     time_t arrival_time;    // 到达时间
-    int duration;           // 预计运行时间
-    int remaining_time;     // 剩余运行时间
+    int duration;           // 预计运行时间（单位：毫秒）
+    int remaining_time;     // 当前时间片的剩余时间（单位：毫秒）
+    unsigned int boost_epoch;   // 所在多级反馈队列的提升轮次
     char **cmdarg;          // 命令行参数
+    struct waitqueue node;  // 作业链表节点
+    struct waitqueue rqnode;    // 就绪队列节点
+    int heapidx;            // 在SJF堆中的下标
+    struct waitqueue agenode;   // 老化时间轮节点
+    int slot;               // 所在的执行槽
+    int pidfd;              // 作业进程的pidfd，-1表示没有
+    int cgroup;             // 是否有自己的cgroup，否则按进程组暂停和终止
+    uint64_t submit_ns;     // 提交时的单调时钟（单位：纳秒）
+    uint64_t first_ns;      // 首次运行的单调时钟，0表示尚未运行
+    uint64_t ready_ns;      // 最近一次进入就绪队列的单调时钟
+    uint64_t queued_ns;     // 在就绪队列中等待的总时间（单位：纳秒）
 };
 
-// 等待队列节点结构体
-struct waitqueue {
-    struct jobinfo *job;    // 作业信息
-    struct waitqueue *next; // 下一个节点
-};
-
-// 作业命令结构体
+// 作业命令结构体，由协议帧解码得到（见proto.h）
 struct jobcmd {
     int type;               // 命令类型
     int owner;              // 所有者ID
     int defpri;             // 默认优先级
     int argnum;             // 参数数量
-    int duration;           // 预计运行时间
-    char data[DATALEN];     // 数据
+    int duration;           // 预计运行时间（单位：毫秒）
+    int jid;                // 出队的作业ID
+    const char *args;       // 参数区：argnum个依次排列、以'\0'结尾的字符串
+    int arglen;             // 参数区长度
 };
 
 // 函数声明
-void error_sys(const char *msg);
-void schedule(void);
-void updateall(void);
+void error_sys(const char *msg) __attribute__((noreturn));    // 打印错误并退出，不返回
+void schedule(int elapsed);
+void updateall(int elapsed);
 void jobswitch(void);
-void do_enq(struct jobinfo *newjob, struct jobcmd enqcmd);
-void do_deq(struct jobcmd deqcmd);
+int do_enq(const struct jobcmd *enqcmd);
+int do_deq(const struct jobcmd *deqcmd);
 void do_stat(void);
 int allocjid(void);
 
-// 调度算法函数指针
-extern struct waitqueue* (*jobselect)(void);
-
 #endif
\ No newline at end of file
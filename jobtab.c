@@ -0,0 +1,263 @@
+/**
+ * @file jobtab.c
+ * @brief 共享内存作业表实现
+ * @details 行号在调度器内按栈分配，释放的行优先复用，用到的页保持紧凑
+ */
+
+#include <stdio.h>      // perror
+#include <stdlib.h>     // malloc
+#include <string.h>     // 字符串处理
+#include <unistd.h>     // ftruncate、getpid
+#include <fcntl.h>      // O_*常量
+#include <sys/mman.h>   // shm_open、mmap
+#include "jobtab.h"     // 作业表定义
+
+#define JOBTAB_SIZE (sizeof(struct jobtab) + sizeof(struct jobrow) * JOBTAB_ROWS)
+#define JOBTAB_SPINS 100000000L     // 读者等待写者的最大自旋次数
+
+static int *freerows = NULL;    // 空闲行号栈
+static int nfree = 0;           // 栈中的行号数
+
+/**
+ * @brief 开始写：序号变为奇数，之后的写入不会早于它被读者看到
+ */
+static void seq_begin(uint32_t *seq)
+{
+	__atomic_store_n(seq, *seq + 1, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+/**
+ * @brief 结束写：序号变回偶数，之前的写入都已对读者可见
+ */
+static void seq_end(uint32_t *seq)
+{
+	__atomic_store_n(seq, *seq + 1, __ATOMIC_RELEASE);
+}
+
+/**
+ * @brief 创建作业表
+ * @param policy 调度算法名
+ * @param nslot 执行槽个数
+ * @return 映射的作业表，失败时返回NULL
+ * @details 先删除上次运行遗留的对象。对象按最大行数设定大小，tmpfs只为写到的页分配内存
+ */
+struct jobtab *jobtab_create(const char *policy, int nslot)
+{
+	struct jobtab *t;
+	int fd;
+
+	shm_unlink(JOBTAB_NAME);
+	if ((fd = shm_open(JOBTAB_NAME, O_RDWR|O_CREAT|O_EXCL|O_CLOEXEC, 0644)) < 0) {
+		perror("shm_open");
+		return NULL;
+	}
+	if (ftruncate(fd, JOBTAB_SIZE) < 0) {
+		perror("ftruncate");
+		goto fail;
+	}
+	t = mmap(NULL, JOBTAB_SIZE, PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0);
+	if (t == MAP_FAILED) {
+		perror("mmap");
+		goto fail;
+	}
+	close(fd);
+
+	if ((freerows = malloc(sizeof(*freerows) * JOBTAB_ROWS)) == NULL)
+		error_sys("malloc failed");
+	t->version = JOBTAB_VERSION;
+	t->pid = getpid();
+	t->nslot = nslot;
+	strncpy(t->policy, policy, sizeof(t->policy) - 1);
+	// 魔数最后写入，读者看到魔数时其他字段已就绪
+	__atomic_store_n(&t->magic, JOBTAB_MAGIC, __ATOMIC_RELEASE);
+	return t;
+
+fail:
+	close(fd);
+	shm_unlink(JOBTAB_NAME);
+	return NULL;
+}
+
+/**
+ * @brief 撤销作业表
+ * @param t jobtab_create()返回的作业表
+ */
+void jobtab_destroy(struct jobtab *t)
+{
+	munmap(t, JOBTAB_SIZE);
+	shm_unlink(JOBTAB_NAME);
+	free(freerows);
+	freerows = NULL;
+	nfree = 0;
+}
+
+/**
+ * @brief 为作业分配一行
+ * @param t 作业表
+ * @return 行号，表满时返回-1并计入overflow
+ */
+int jobtab_alloc(struct jobtab *t)
+{
+	uint32_t row;
+
+	if (nfree > 0)
+		return freerows[--nfree];
+
+	seq_begin(&t->seq);
+	if (t->hwm < JOBTAB_ROWS) {
+		row = t->hwm;
+		__atomic_store_n(&t->hwm, row + 1, __ATOMIC_RELAXED);
+	} else {
+		row = (uint32_t)-1;
+		t->overflow++;
+	}
+	seq_end(&t->seq);
+	return (int)row;
+}
+
+/**
+ * @brief 清空并释放一行
+ * @param t 作业表
+ * @param row jobtab_alloc()返回的行号，-1时只减少overflow
+ */
+void jobtab_free(struct jobtab *t, int row)
+{
+	struct jobrow *r;
+
+	if (row < 0) {
+		seq_begin(&t->seq);
+		t->overflow--;
+		seq_end(&t->seq);
+		return;
+	}
+	r = &t->rows[row];
+	seq_begin(&r->seq);
+	r->jid = 0;
+	seq_end(&r->seq);
+	freerows[nfree++] = row;
+}
+
+/**
+ * @brief 发布作业的当前状态
+ * @param t 作业表
+ * @param row 作业所在的行，-1表示未发布
+ * @param job 作业
+ */
+void jobtab_put(struct jobtab *t, int row, const struct jobinfo *job)
+{
+	struct jobrow *r;
+
+	if (row < 0)
+		return;
+	r = &t->rows[row];
+	seq_begin(&r->seq);
+	r->jid = job->jid;
+	r->pid = job->pid;
+	r->ownerid = job->ownerid;
+	r->defpri = job->defpri;
+	r->curpri = job->curpri;
+	r->state = job->state;
+	r->slot = job->slot;
+	r->run_time = job->run_time;
+	r->duration = job->duration;
+	r->wait_base = job->wait_base;
+	r->wait_time = job->wait_time;
+	r->create_time = job->create_time;
+	seq_end(&r->seq);
+}
+
+/**
+ * @brief 发布调度时钟
+ * @param t 作业表
+ * @param clock_ms 调度时钟（单位：毫秒）
+ */
+void jobtab_clock(struct jobtab *t, long clock_ms)
+{
+	seq_begin(&t->seq);
+	t->clock_ms = clock_ms;
+	seq_end(&t->seq);
+}
+
+/**
+ * @brief 以只读方式映射作业表
+ * @return 作业表，调度器未运行或表无效时返回NULL
+ */
+struct jobtab *jobtab_open()
+{
+	struct jobtab *t;
+	int fd;
+
+	if ((fd = shm_open(JOBTAB_NAME, O_RDONLY|O_CLOEXEC, 0)) < 0)
+		return NULL;
+	t = mmap(NULL, JOBTAB_SIZE, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (t == MAP_FAILED)
+		return NULL;
+	if (__atomic_load_n(&t->magic, __ATOMIC_ACQUIRE) != JOBTAB_MAGIC ||
+	    t->version != JOBTAB_VERSION) {
+		munmap(t, JOBTAB_SIZE);
+		return NULL;
+	}
+	return t;
+}
+
+/**
+ * @brief 等待写者写完，读出偶数序号
+ * @return 序号，写者长时间未写完（调度器在写的中途退出）时返回奇数
+ */
+static uint32_t seq_read(const uint32_t *seq)
+{
+	uint32_t s;
+	long spins = 0;
+
+	while (((s = __atomic_load_n(seq, __ATOMIC_ACQUIRE)) & 1) && spins++ < JOBTAB_SPINS)
+		;
+	return s;
+}
+
+/**
+ * @brief 读取一行的一致快照
+ * @param t 作业表
+ * @param row 行号
+ * @param out 输出
+ * @return 1表示该行有作业，0表示空行，-1表示该行一直处于写状态
+ */
+int jobtab_get(const struct jobtab *t, uint32_t row, struct jobrow *out)
+{
+	const struct jobrow *r = &t->rows[row];
+	uint32_t s1, s2;
+
+	do {
+		if ((s1 = seq_read(&r->seq)) & 1)
+			return -1;
+		memcpy(out, r, sizeof(*out));
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+		s2 = __atomic_load_n(&r->seq, __ATOMIC_RELAXED);
+	} while (s1 != s2);
+	return out->jid != 0;
+}
+
+/**
+ * @brief 读取表头的一致快照
+ * @param t 作业表
+ * @param hwm 输出用到过的行数
+ * @param overflow 输出未发布的作业数
+ * @param clock_ms 输出调度时钟
+ * @return 0表示成功，-1表示表头一直处于写状态
+ */
+int jobtab_head(const struct jobtab *t, uint32_t *hwm, uint32_t *overflow, int64_t *clock_ms)
+{
+	uint32_t s1, s2;
+
+	do {
+		if ((s1 = seq_read(&t->seq)) & 1)
+			return -1;
+		*hwm = t->hwm;
+		*overflow = t->overflow;
+		*clock_ms = t->clock_ms;
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+		s2 = __atomic_load_n(&t->seq, __ATOMIC_RELAXED);
+	} while (s1 != s2);
+	return 0;
+}
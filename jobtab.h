@@ -0,0 +1,66 @@
+/**
+ * @file jobtab.h
+ * @brief 共享内存作业表
+ * @details 调度器把作业表的快照发布在/dev/shm中，stat命令直接映射读取，
+ *          不经过FIFO，也不打断调度器的事件循环。调度器是唯一的写者，每行和表头
+ *          各有一个顺序锁：写之前序号加1变为奇数，写完再加1变为偶数；读者读到奇数
+ *          或读前后序号不同时重读，写者从不等待读者
+ */
+
+#ifndef _JOBTAB_H
+#define _JOBTAB_H
+
+#include <stdint.h>
+#include "job.h"
+
+#define JOBTAB_NAME "/jobtab"       // 共享内存对象名，对应/dev/shm/jobtab
+#define JOBTAB_MAGIC 0x4a544231     // 表头魔数
+#define JOBTAB_VERSION 2            // 表格式版本
+#define JOBTAB_ROWS (1 << 18)       // 行数上限，只有用到的页才占用内存
+
+// 作业表的一行，jid为0表示空行
+struct jobrow {
+    uint32_t seq;           // 顺序锁序号，奇数表示正在写
+    int32_t jid;            // 作业ID
+    int32_t pid;            // 进程ID，0表示尚未创建进程
+    int32_t ownerid;        // 所有者ID
+    int32_t defpri;         // 默认优先级
+    int32_t curpri;         // 当前优先级
+    int32_t state;          // 作业状态
+    int32_t slot;           // 所在的执行槽
+    int32_t run_time;       // 已使用的CPU时间（单位：毫秒）
+    int32_t duration;       // 预计运行时间
+    int64_t wait_base;      // 等待中作业的等待时间为调度时钟减去它
+    int64_t wait_time;      // 运行中作业此前在就绪队列中等待的总时间（单位：毫秒）
+    int64_t create_time;    // 创建时间
+};
+
+// 表头，后接JOBTAB_ROWS行
+struct jobtab {
+    uint32_t magic;         // 魔数
+    uint32_t version;       // 表格式版本
+    int32_t pid;            // 调度器进程号，读者据此判断表是否已过期
+    int32_t nslot;          // 执行槽个数
+    char policy[16];        // 调度算法名
+    uint32_t seq;           // 表头顺序锁序号，保护下面的字段
+    uint32_t hwm;           // 用到过的最大行号加1，读者只需扫描这些行
+    uint32_t overflow;      // 因表满而未发布的作业数
+    uint32_t pad;
+    int64_t clock_ms;       // 调度时钟（单位：毫秒）
+    struct jobrow rows[];
+};
+
+// 调度器
+struct jobtab *jobtab_create(const char *policy, int nslot);
+void jobtab_destroy(struct jobtab *t);
+int jobtab_alloc(struct jobtab *t);
+void jobtab_free(struct jobtab *t, int row);
+void jobtab_put(struct jobtab *t, int row, const struct jobinfo *job);
+void jobtab_clock(struct jobtab *t, long clock_ms);
+
+// 读者
+struct jobtab *jobtab_open(void);
+int jobtab_get(const struct jobtab *t, uint32_t row, struct jobrow *out);
+int jobtab_head(const struct jobtab *t, uint32_t *hwm, uint32_t *overflow, int64_t *clock_ms);
+
+#endif
@@ -0,0 +1,237 @@
+/**
+ * @file launcher.c
+ * @brief 作业启动进程实现
+ * @details 调度器与启动进程之间用SOCK_SEQPACKET套接字对通信，每个请求和应答各是一条消息
+ */
+
+#define _GNU_SOURCE     // clone、CLONE_*、sched_setaffinity
+
+#include <stdio.h>      // perror
+#include <stdlib.h>     // malloc
+#include <string.h>     // 字符串处理
+#include <unistd.h>     // 系统调用接口
+#include <errno.h>      // 错误码
+#include <signal.h>     // 信号处理
+#include <sched.h>      // clone、CPU亲和性
+#include <fcntl.h>      // open
+#include <sys/socket.h> // 套接字
+#include "launcher.h"   // 启动进程定义
+
+// 传给克隆子进程的参数，与启动进程共享内存
+struct launchargs {
+    int cpu;                // 绑定的CPU
+    int outfd;              // 作业的标准输出
+    char **argv;            // 参数数组
+    const char *cgprocs;    // 要加入的cgroup的cgroup.procs路径，NULL表示不加入
+    int err;                // 执行失败时由子进程写入的错误码
+    int cgerr;              // 加入cgroup失败时由子进程写入的错误码
+};
+
+/**
+ * @brief 把调用进程加入cgroup
+ * @param cgprocs cgroup的cgroup.procs路径
+ * @return 0表示成功，否则为错误码
+ * @details 向cgroup.procs写入0表示移动写入者自己。只使用系统调用，可在克隆子进程中调用
+ */
+int cgroup_join(const char *cgprocs)
+{
+	int fd, err = 0;
+
+	if ((fd = open(cgprocs, O_WRONLY|O_CLOEXEC)) < 0)
+		return errno;
+	if (write(fd, "0", 1) < 0)
+		err = errno;
+	close(fd);
+	return err;
+}
+
+/**
+ * @brief 克隆子进程的入口
+ * @param arg 启动参数
+ * @return 不返回
+ * @details 与启动进程共享地址空间，且启动进程在它执行程序或退出前一直挂起，
+ *          这里只调用系统调用，不修改共享的堆
+ */
+static int launch_child(void *arg)
+{
+	struct launchargs *a = arg;
+	cpu_set_t set;
+
+	// 启动进程忽略了SIGINT，作业应恢复默认处理
+	signal(SIGINT, SIG_DFL);
+
+	// 作业自成一个进程组，并在执行程序前加入自己的cgroup，之后创建的子孙进程都随之暂停和终止
+	setpgid(0, 0);
+	if (a->cgprocs != NULL)
+		a->cgerr = cgroup_join(a->cgprocs);
+	if (a->cpu >= 0) {
+		CPU_ZERO(&set);
+		CPU_SET(a->cpu, &set);
+		sched_setaffinity(0, sizeof(set), &set);
+	}
+
+	dup2(a->outfd, 1);
+	execv(a->argv[0], a->argv);
+	a->err = errno;
+	_exit(127);
+}
+
+/**
+ * @brief 启动进程主循环
+ * @param sock 与调度器通信的套接字
+ * @param outfd 作业的标准输出
+ * @details 调度器关闭套接字后退出
+ */
+static void launcher_main(int sock, int outfd)
+{
+	struct launchreq req;
+	struct launchrep rep;
+	struct launchargs a;
+	char *buf, *stack, *q;
+	char **argv = NULL;
+	ssize_t n;
+	uint32_t i, maxargs = 0;
+
+	if ((buf = malloc(LAUNCH_MAXMSG)) == NULL || (stack = malloc(LAUNCH_STACK)) == NULL)
+		_exit(1);
+
+	for (;;) {
+		if ((n = recv(sock, buf, LAUNCH_MAXMSG, 0)) <= 0) {
+			if (n < 0 && errno == EINTR)
+				continue;
+			_exit(0);
+		}
+
+		memcpy(&req, buf, sizeof(req));
+		rep.pid = -1;
+		rep.err = EINVAL;
+		rep.cgerr = 0;
+		if ((size_t)n != sizeof(req) + req.arglen + req.cglen || req.argc == 0 ||
+		    buf[sizeof(req) + req.arglen - 1] != '\0' || buf[n - 1] != '\0')
+			goto reply;
+
+		// 参数数组按需扩大，启动进程常驻，不会反复分配
+		if (req.argc + 1 > maxargs) {
+			maxargs = req.argc + 1;
+			if ((argv = realloc(argv, sizeof(*argv) * maxargs)) == NULL)
+				_exit(1);
+		}
+		q = buf + sizeof(req);
+		for (i = 0; i < req.argc && q < buf + sizeof(req) + req.arglen; i++) {
+			argv[i] = q;
+			q += strlen(q) + 1;
+		}
+		if (i < req.argc)
+			goto reply;
+		argv[i] = NULL;
+
+		a.cpu = req.cpu;
+		a.outfd = outfd;
+		a.argv = argv;
+		a.cgprocs = req.cglen > 0 ? buf + sizeof(req) + req.arglen : NULL;
+		a.err = 0;
+		a.cgerr = 0;
+		rep.pid = clone(launch_child, stack + LAUNCH_STACK,
+			CLONE_VM | CLONE_VFORK | CLONE_PARENT | SIGCHLD, &a);
+		rep.err = rep.pid < 0 ? errno : a.err;
+		rep.cgerr = a.cgerr;
+
+	reply:
+		while (send(sock, &rep, sizeof(rep), MSG_NOSIGNAL) < 0)
+			if (errno != EINTR)
+				_exit(1);
+	}
+}
+
+/**
+ * @brief 创建启动进程
+ * @param outfd 作业的标准输出
+ * @return 与启动进程通信的套接字，失败时返回-1
+ * @details 应在调度器打开其他文件、占用大量内存之前调用
+ */
+int launcher_start(int outfd)
+{
+	int sv[2];
+
+	if (socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0, sv) < 0) {
+		perror("socketpair");
+		return -1;
+	}
+
+	switch (fork()) {
+	case -1:
+		perror("fork");
+		close(sv[0]);
+		close(sv[1]);
+		return -1;
+	case 0:     // 启动进程：不响应终端的SIGINT，随调度器关闭套接字退出
+		close(sv[0]);
+		signal(SIGINT, SIG_IGN);
+		launcher_main(sv[1], outfd);
+		_exit(0);
+	default:
+		close(sv[1]);
+		return sv[0];
+	}
+}
+
+/**
+ * @brief 请求启动进程创建作业进程
+ * @param sock launcher_start()返回的套接字
+ * @param cpu 绑定的CPU，-1表示不绑定
+ * @param cgprocs 作业要加入的cgroup的cgroup.procs路径，NULL表示不加入
+ * @param argv 以NULL结尾的参数数组
+ * @param cgerr 返回加入cgroup的结果：0表示成功或未要求，否则为错误码
+ * @return 作业进程号；-1表示程序无法执行（errno为原因），
+ *         -2表示启动进程不可用或请求过长，调用者应自己创建进程
+ * @details 作业进程在执行程序前已成为自己进程组的组长
+ */
+int launcher_spawn(int sock, int cpu, const char *cgprocs, char *const argv[], int *cgerr)
+{
+	struct launchreq req;
+	struct launchrep rep;
+	char buf[LAUNCH_MAXMSG];
+	size_t len = sizeof(req), n;
+	ssize_t ret;
+	int i;
+
+	if (sock < 0)
+		return -2;
+
+	for (i = 0; argv[i] != NULL; i++) {
+		n = strlen(argv[i]) + 1;
+		if (len + n > sizeof(buf))
+			return -2;
+		memcpy(buf + len, argv[i], n);
+		len += n;
+	}
+	req.cpu = cpu;
+	req.argc = i;
+	req.arglen = len - sizeof(req);
+	req.cglen = 0;
+	if (cgprocs != NULL) {
+		n = strlen(cgprocs) + 1;
+		if (len + n > sizeof(buf))
+			return -2;
+		memcpy(buf + len, cgprocs, n);
+		len += n;
+		req.cglen = n;
+	}
+	memcpy(buf, &req, sizeof(req));
+
+	while ((ret = send(sock, buf, len, MSG_NOSIGNAL)) < 0 && errno == EINTR)
+		;
+	if (ret < 0)
+		return -2;
+	while ((ret = recv(sock, &rep, sizeof(rep), 0)) < 0 && errno == EINTR)
+		;
+	if (ret != sizeof(rep))
+		return -2;
+
+	*cgerr = rep.cgerr;
+	if (rep.pid < 0 || rep.err != 0) {
+		errno = rep.err;
+		return -1;
+	}
+	return rep.pid;
+}
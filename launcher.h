@@ -0,0 +1,37 @@
+/**
+ * @file launcher.h
+ * @brief 作业启动进程
+ * @details 调度器启动时创建一个很小的启动进程，之后所有作业进程都由它创建。
+ *          它以CLONE_VM|CLONE_VFORK方式克隆子进程，不复制页表，启动延迟与调度器
+ *          占用的内存大小无关；同时带CLONE_PARENT，作业进程仍是调度器的子进程，
+ *          由调度器回收并接收其SIGCHLD。作业进程在执行程序前自成进程组，并可加入指定的cgroup
+ */
+
+#ifndef _LAUNCHER_H
+#define _LAUNCHER_H
+
+#include <stdint.h>
+
+#define LAUNCH_MAXMSG 65536     // 启动请求的最大长度，超过时由调度器自己创建进程
+#define LAUNCH_STACK 65536      // 克隆子进程使用的栈大小
+
+// 启动请求，后接argc个依次排列、以'\0'结尾的参数，再接cglen字节的cgroup.procs路径
+struct launchreq {
+    int32_t cpu;            // 绑定的CPU，-1表示不绑定
+    uint32_t argc;          // 参数个数
+    uint32_t arglen;        // 参数区长度
+    uint32_t cglen;         // cgroup.procs路径长度（含'\0'），0表示不加入cgroup
+};
+
+// 启动应答
+struct launchrep {
+    int32_t pid;            // 作业进程号，失败时为-1
+    int32_t err;            // 失败时的错误码
+    int32_t cgerr;          // 加入cgroup失败时的错误码，0表示成功或未要求
+};
+
+int launcher_start(int outfd);
+int launcher_spawn(int sock, int cpu, const char *cgprocs, char *const argv[], int *cgerr);
+int cgroup_join(const char *cgprocs);
+
+#endif
@@ -0,0 +1,575 @@
+/**
+ * @file loadgen.c
+ * @brief 端到端提交负载生成器
+ * @details 启动若干并发的提交进程，按泊松、突发或记录的到达过程向调度器提交作业，
+ *          作业长度和优先级按指定的分布抽取。提交的作业就是本程序自己（负载模式，取代sample.c）：
+ *          作业进程在首次被调度时才创建，它一开始运行就记下调度时刻，消耗完指定的CPU时间后
+ *          把提交、调度和结束时刻发回生成器。生成器汇总提交到调度、提交到结束的延迟百分位和
+ *          持续的吞吐量。延迟从计划的到达时刻算起，提交进程自身的拖延也计入延迟
+ */
+
+#include <stdio.h>       // 标准输入输出
+#include <stdlib.h>      // 动态内存分配
+#include <stdint.h>      // 定长整数类型
+#include <string.h>      // 字符串处理
+#include <unistd.h>      // 系统调用接口
+#include <errno.h>       // 错误码
+#include <fcntl.h>       // 文件控制
+#include <math.h>        // log
+#include <time.h>        // 时钟
+#include <poll.h>        // 等待报告
+#include <sys/socket.h>  // 报告套接字
+#include <sys/un.h>      // sockaddr_un
+#include <sys/stat.h>    // chmod
+#include <sys/wait.h>    // 回收提交进程
+#include "job.h"         // 作业相关定义
+#include "proto.h"       // 命令协议
+
+#define MAXSUBMIT 1024          // 提交进程个数上限
+#define REPORT_JOB 1            // 报告类型：作业结束
+#define REPORT_DONE 2           // 报告类型：提交进程结束
+
+// 作业和提交进程发回生成器的报告，每条是一个数据报
+struct report {
+	int32_t type;           // REPORT_JOB或REPORT_DONE
+	int32_t seq;            // 作业序号；提交进程为它的序号
+	int32_t submitted;      // 提交进程成功提交的作业数
+	int32_t failed;         // 提交进程未能提交的作业数
+	int64_t submit_ns;      // 作业计划的到达时刻；提交进程第一次提交的时刻
+	int64_t start_ns;       // 作业开始运行的时刻；提交进程最后一次提交的时刻
+	int64_t end_ns;         // 作业结束的时刻
+};
+
+// 一个要提交的作业
+struct plan {
+	int64_t arrival;        // 计划的到达时刻（相对开始时刻，单位：纳秒）
+	int length;             // 实际运行时间（单位：毫秒）
+	int duration;           // 交给调度器的预计运行时间
+	int defpri;             // 默认优先级
+};
+
+// 作业长度分布
+enum { LEN_FIXED, LEN_UNIFORM, LEN_EXP };
+
+int nsubmit = 4;            // 提交进程个数
+int njobs = 1000;           // 作业总数
+double rate = 100;          // 平均到达速率（每秒作业数）
+int burst = 1;              // 突发到达时每批的作业数，1表示泊松到达
+const char *tracefile = NULL;   // 记录的负载，格式与模拟器相同
+int lenkind = LEN_EXP;      // 作业长度分布
+double len1 = 20, len2 = 0; // 分布参数：固定值或均值；均匀分布的上下限
+int priw[4] = { 1, 1, 1, 1 };   // 各默认优先级的权重
+int spin = 1;               // 作业消耗CPU时间，否则只睡眠
+int usefifo = 0;            // 只经FIFO提交
+int idle = 30;              // 提交结束后等待报告的最长空闲时间（单位：秒）
+char report_path[64];       // 报告套接字路径
+char selfexe[4096];         // 本程序的绝对路径，作为作业的可执行文件
+uint64_t rng;               // 随机数状态
+
+/**
+ * @brief 读取单调时钟
+ * @return 当前时刻（单位：纳秒），各进程的读数可以直接比较
+ */
+int64_t now_ns()
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (int64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+/**
+ * @brief 读取本进程已使用的CPU时间
+ * @return 纳秒
+ */
+int64_t cpu_ns()
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+	return (int64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+/**
+ * @brief 生成伪随机数（xorshift64*）
+ */
+uint64_t rnd()
+{
+	rng ^= rng >> 12;
+	rng ^= rng << 25;
+	rng ^= rng >> 27;
+	return rng * 2685821657736338717ULL;
+}
+
+/**
+ * @brief 指数分布随机数
+ * @param mean 均值
+ */
+double rnd_exp(double mean)
+{
+	return -mean * log(((rnd() >> 11) + 1.0) / 9007199254740993.0);
+}
+
+/**
+ * @brief 按长度分布抽取作业长度
+ * @return 毫秒，限制在1-65535
+ */
+int rnd_length()
+{
+	double d;
+
+	if (lenkind == LEN_FIXED)
+		d = len1;
+	else if (lenkind == LEN_UNIFORM)
+		d = len1 + (double)(rnd() >> 11) / 9007199254740992.0 * (len2 - len1 + 1);
+	else
+		d = rnd_exp(len1);
+	return d < 1 ? 1 : d > 65535 ? 65535 : (int)d;
+}
+
+/**
+ * @brief 按优先级权重抽取默认优先级
+ */
+int rnd_priority()
+{
+	int i, total = priw[0] + priw[1] + priw[2] + priw[3];
+	int r = rnd() % total;
+
+	for (i = 0; r >= priw[i]; i++)
+		r -= priw[i];
+	return i;
+}
+
+/**
+ * @brief 负载模式：作为作业运行，结束时向生成器报告
+ * @param argv -W 报告套接字 作业序号 计划到达时刻 长度 spin|sleep
+ * @return 0
+ */
+int payload(char *argv[])
+{
+	struct sockaddr_un addr;
+	struct report r;
+	struct timespec ts;
+	int64_t length, c0;
+	int fd;
+
+	memset(&r, 0, sizeof(r));
+	r.start_ns = now_ns();
+	r.type = REPORT_JOB;
+	r.seq = atoi(argv[3]);
+	r.submit_ns = strtoll(argv[4], NULL, 10);
+	length = atoll(argv[5]) * 1000000LL;
+
+	if (strcmp(argv[6], "spin") == 0) {
+		// 消耗指定的CPU时间，被暂停的时间不计
+		for (c0 = cpu_ns(); cpu_ns() - c0 < length; )
+			;
+	} else {
+		ts.tv_sec = length / 1000000000LL;
+		ts.tv_nsec = length % 1000000000LL;
+		while (nanosleep(&ts, &ts) < 0 && errno == EINTR)
+			;
+	}
+	r.end_ns = now_ns();
+
+	if ((fd = socket(AF_UNIX, SOCK_DGRAM, 0)) < 0)
+		return 1;
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strncpy(addr.sun_path, argv[2], sizeof(addr.sun_path) - 1);
+	sendto(fd, &r, sizeof(r), 0, (struct sockaddr *)&addr, sizeof(addr));
+	close(fd);
+	return 0;
+}
+
+/**
+ * @brief 读取记录的负载
+ * @param path 文件名，每行：到达时刻 预计运行时间 [默认优先级 [所有者ID [实际运行时间]]]
+ * @param plans 输出的作业，按文件中的顺序
+ * @return 作业数，-1表示出错
+ */
+int load_trace(const char *path, struct plan **plans)
+{
+	FILE *fp;
+	char buf[256], *s;
+	long arrival;
+	int n = 0, cap = 0, f, d, p, o, a, lineno = 0;
+
+	if ((fp = fopen(path, "r")) == NULL) {
+		perror(path);
+		return -1;
+	}
+	while (fgets(buf, sizeof(buf), fp) != NULL) {
+		lineno++;
+		for (s = buf; *s == ' ' || *s == '\t'; s++)
+			;
+		if (*s == '#' || *s == '\n' || *s == '\0')
+			continue;
+		p = o = 0;
+		a = -1;
+		f = sscanf(s, "%ld %d %d %d %d", &arrival, &d, &p, &o, &a);
+		if (f < 5)
+			a = d;
+		if (f < 2 || arrival < 0 || d < 0 || d > 65535 || p < 0 || p > 3 || a < 0) {
+			fprintf(stderr, "%s:%d: invalid job\n", path, lineno);
+			fclose(fp);
+			return -1;
+		}
+		if (n == cap) {
+			cap = cap ? cap * 2 : 1024;
+			if ((*plans = realloc(*plans, cap * sizeof(**plans))) == NULL)
+				error_sys("realloc failed");
+		}
+		(*plans)[n].arrival = arrival * 1000000LL;
+		(*plans)[n].duration = d;
+		(*plans)[n].length = a ? a : 1;
+		(*plans)[n].defpri = p;
+		n++;
+	}
+	fclose(fp);
+	return n;
+}
+
+/**
+ * @brief 编码一个负载作业的入队帧
+ * @param buf 输出缓冲区，至少PROTO_MAXMSG字节
+ * @param seq 作业序号
+ * @param submit 计划到达时刻（单调时钟，单位：纳秒）
+ * @param pl 作业
+ * @return 帧长度
+ */
+size_t putjob(char *buf, int seq, int64_t submit, const struct plan *pl)
+{
+	char s_seq[16], s_submit[24], s_len[16];
+	char *argv[] = { selfexe, "-W", report_path, s_seq, s_submit, s_len,
+		spin ? "spin" : "sleep", NULL };
+	size_t len;
+
+	snprintf(s_seq, sizeof(s_seq), "%d", seq);
+	snprintf(s_submit, sizeof(s_submit), "%lld", (long long)submit);
+	snprintf(s_len, sizeof(s_len), "%d", pl->length);
+	len = proto_enqsize(7, argv);
+	proto_putenq(buf + proto_head(buf, MSG_ENQ, len), getuid(), pl->defpri,
+		pl->duration, 7, argv);
+	return sizeof(struct msghead) + len;
+}
+
+/**
+ * @brief 提交进程：按计划的到达时刻依次提交作业
+ * @param id 提交进程序号，负责序号为id、id+nsubmit、...的作业
+ * @param plans 全部作业
+ * @param t0 开始时刻（单调时钟，单位：纳秒）
+ * @return 进程退出码
+ * @details 经控制套接字提交时不等应答就继续发送，最多PROTO_WINDOW个请求未收到应答
+ */
+int submitter(int id, const struct plan *plans, int64_t t0)
+{
+	char buf[PROTO_MAXMSG], reply[PROTO_MAXMSG];
+	struct sockaddr_un addr;
+	struct replybody rep;
+	struct report r;
+	struct timespec ts;
+	int64_t at;
+	size_t len;
+	int seq, fd = -1, sock = -1, inflight = 0;
+
+	memset(&r, 0, sizeof(r));
+	r.type = REPORT_DONE;
+	r.seq = id;
+	if (!usefifo)
+		sock = proto_connect();
+	if (sock < 0 && (fd = open(FIFO, O_WRONLY)) < 0) {
+		perror("open fifo");
+		return 1;
+	}
+
+	for (seq = id; seq < njobs; seq += nsubmit) {
+		// 等到计划的到达时刻，已经落后时立即提交
+		at = t0 + plans[seq].arrival;
+		ts.tv_sec = at / 1000000000LL;
+		ts.tv_nsec = at % 1000000000LL;
+		while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR)
+			;
+
+		len = putjob(buf, seq, at, &plans[seq]);
+		if (r.submit_ns == 0)
+			r.submit_ns = now_ns();
+		if (sock >= 0) {
+			if (inflight == PROTO_WINDOW) {
+				if (proto_recvreply(sock, reply, sizeof(reply), &rep) < 0)
+					break;
+				inflight--;
+				if (rep.status != 0)
+					r.failed++, r.submitted--;
+			}
+			if (send(sock, buf, len, MSG_NOSIGNAL) < 0) {
+				r.failed++;
+				continue;
+			}
+			inflight++;
+		} else if (proto_send(fd, buf, len) < 0) {
+			r.failed++;
+			continue;
+		}
+		r.submitted++;
+		r.start_ns = now_ns();
+	}
+
+	// 读取剩余的应答
+	while (inflight > 0 && proto_recvreply(sock, reply, sizeof(reply), &rep) >= 0) {
+		inflight--;
+		if (rep.status != 0)
+			r.failed++, r.submitted--;
+	}
+	r.failed += inflight;
+	r.submitted -= inflight;
+
+	if ((fd >= 0 && close(fd) < 0) || (sock >= 0 && close(sock) < 0))
+		perror("close");
+	if ((fd = socket(AF_UNIX, SOCK_DGRAM, 0)) < 0)
+		return 1;
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strncpy(addr.sun_path, report_path, sizeof(addr.sun_path) - 1);
+	sendto(fd, &r, sizeof(r), 0, (struct sockaddr *)&addr, sizeof(addr));
+	close(fd);
+	return 0;
+}
+
+/**
+ * @brief 64位整数比较函数
+ */
+int i64cmp(const void *a, const void *b)
+{
+	int64_t x = *(const int64_t *)a, y = *(const int64_t *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+/**
+ * @brief 打印一组延迟的百分位
+ * @param name 名称
+ * @param v 延迟（单位：纳秒），会被排序
+ * @param n 个数
+ */
+void percentiles(const char *name, int64_t *v, int n)
+{
+	static const double pct[] = { 50, 90, 99, 99.9 };
+	int i;
+
+	if (n == 0)
+		return;
+	qsort(v, n, sizeof(*v), i64cmp);
+	printf("%-20s", name);
+	for (i = 0; i < 4; i++)
+		printf(" %10.3f", v[(long)((n - 1) * pct[i] / 100)] / 1e6);
+	printf(" %10.3f\n", v[n - 1] / 1e6);
+}
+
+/**
+ * @brief 解析长度分布
+ * @param s fixed:MS、uniform:LO-HI或exp:MEAN
+ * @return 0表示成功，-1表示格式错误
+ */
+int parse_length(const char *s)
+{
+	if (sscanf(s, "fixed:%lf", &len1) == 1 && len1 >= 1)
+		lenkind = LEN_FIXED;
+	else if (sscanf(s, "uniform:%lf-%lf", &len1, &len2) == 2 && len1 >= 1 && len2 >= len1)
+		lenkind = LEN_UNIFORM;
+	else if (sscanf(s, "exp:%lf", &len1) == 1 && len1 > 0)
+		lenkind = LEN_EXP;
+	else
+		return -1;
+	return 0;
+}
+
+/**
+ * @brief 打印使用说明
+ */
+void usage()
+{
+	printf("Usage: loadgen [-c submitters] [-n jobs] [-r jobs/s] [-b burst] [-t trace]\n"
+		"               [-l length] [-p w0,w1,w2,w3] [-k spin|sleep] [-s seed] [-w secs] [-f]\n"
+		"  -c submitters  concurrent submitting processes, default 4\n"
+		"  -n jobs        number of jobs, default 1000\n"
+		"  -r jobs/s      mean arrival rate, default 100\n"
+		"  -b burst       arrive in bursts of this many jobs (Poisson bursts), default 1 = Poisson\n"
+		"  -t trace       replay a recorded workload (same format as sim), overrides -n -r -b -l -p\n"
+		"  -l length      job length: fixed:MS, uniform:LO-HI or exp:MEAN, default exp:20\n"
+		"  -p weights     relative weights of priorities 0-3, default 1,1,1,1\n"
+		"  -k spin|sleep  jobs burn CPU time (default) or just sleep\n"
+		"  -s seed        random seed\n"
+		"  -w secs        give up after this long without a report, default 30\n"
+		"  -f             submit through the fifo even if the control socket exists\n");
+}
+
+int main(int argc, char *argv[])
+{
+	struct sockaddr_un addr;
+	struct plan *plans = NULL;
+	struct report r;
+	struct pollfd pfd;
+	int64_t t0, t, *dispatch, *complete, first = 0, last = 0, lastend = 0;
+	int i, c, fd, submitted = 0, failed = 0, ndone = 0, nsub = 0, ret;
+	uint64_t seed = 88172645463325252ULL;
+	ssize_t n;
+
+	// 作为作业运行
+	if (argc == 7 && strcmp(argv[1], "-W") == 0)
+		return payload(argv);
+
+	while ((c = getopt(argc, argv, "c:n:r:b:t:l:p:k:s:w:f")) != -1) {
+		switch (c) {
+		case 'c':
+			nsubmit = atoi(optarg);
+			break;
+		case 'n':
+			njobs = atoi(optarg);
+			break;
+		case 'r':
+			rate = atof(optarg);
+			break;
+		case 'b':
+			burst = atoi(optarg);
+			break;
+		case 't':
+			tracefile = optarg;
+			break;
+		case 'l':
+			if (parse_length(optarg) < 0) {
+				printf("invalid length distribution: %s\n", optarg);
+				return 1;
+			}
+			break;
+		case 'p':
+			if (sscanf(optarg, "%d,%d,%d,%d", &priw[0], &priw[1], &priw[2], &priw[3]) != 4 ||
+			    priw[0] < 0 || priw[1] < 0 || priw[2] < 0 || priw[3] < 0 ||
+			    priw[0] + priw[1] + priw[2] + priw[3] == 0) {
+				printf("invalid priority weights: %s\n", optarg);
+				return 1;
+			}
+			break;
+		case 'k':
+			spin = strcmp(optarg, "sleep") != 0;
+			break;
+		case 's':
+			seed = strtoull(optarg, NULL, 0) | 1;
+			break;
+		case 'w':
+			idle = atoi(optarg);
+			break;
+		case 'f':
+			usefifo = 1;
+			break;
+		default:
+			usage();
+			return 1;
+		}
+	}
+	if (nsubmit < 1 || nsubmit > MAXSUBMIT || njobs < 1 || rate <= 0 || burst < 1 || idle < 1) {
+		usage();
+		return 1;
+	}
+	if ((n = readlink("/proc/self/exe", selfexe, sizeof(selfexe) - 1)) < 0)
+		error_sys("readlink failed");
+	selfexe[n] = '\0';
+
+	// 生成作业计划：突发到达时每批作业同时到达，批与批之间为泊松过程
+	rng = seed;
+	if (tracefile != NULL) {
+		if ((njobs = load_trace(tracefile, &plans)) <= 0)
+			return 1;
+	} else {
+		if ((plans = malloc(sizeof(*plans) * njobs)) == NULL)
+			error_sys("malloc failed");
+		for (i = 0, t = 0; i < njobs; i++) {
+			if (i % burst == 0)
+				t += rnd_exp(1e9 * burst / rate);
+			plans[i].arrival = t;
+			plans[i].length = rnd_length();
+			plans[i].duration = plans[i].length;
+			plans[i].defpri = rnd_priority();
+		}
+	}
+	if ((dispatch = malloc(sizeof(*dispatch) * njobs)) == NULL ||
+	    (complete = malloc(sizeof(*complete) * njobs)) == NULL)
+		error_sys("malloc failed");
+
+	// 报告套接字，作业进程可能以其他用户运行
+	snprintf(report_path, sizeof(report_path), "/tmp/loadgen.%d", (int)getpid());
+	if ((fd = socket(AF_UNIX, SOCK_DGRAM | SOCK_CLOEXEC, 0)) < 0)
+		error_sys("socket failed");
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strncpy(addr.sun_path, report_path, sizeof(addr.sun_path) - 1);
+	unlink(report_path);
+	if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0)
+		error_sys("bind failed");
+	chmod(report_path, 0666);
+	c = 4 << 20;
+	setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &c, sizeof(c));
+
+	// 启动提交进程，留出启动时间后同时开始
+	t0 = now_ns() + 100000000LL;
+	for (i = 0; i < nsubmit; i++) {
+		switch (fork()) {
+		case -1:
+			error_sys("fork failed");
+			break;
+		case 0:
+			close(fd);
+			exit(submitter(i, plans, t0));
+		}
+	}
+
+	// 收集报告，直到所有提交的作业都结束，或者长时间没有报告
+	pfd.fd = fd;
+	pfd.events = POLLIN;
+	while (nsub < nsubmit || ndone < submitted) {
+		if ((ret = poll(&pfd, 1, idle * 1000)) < 0) {
+			if (errno == EINTR)
+				continue;
+			error_sys("poll failed");
+		}
+		if (ret == 0) {
+			printf("no report for %d s, giving up\n", idle);
+			break;
+		}
+		if ((n = recv(fd, &r, sizeof(r), 0)) != sizeof(r))
+			continue;
+		if (r.type == REPORT_DONE) {
+			nsub++;
+			submitted += r.submitted;
+			failed += r.failed;
+			if (r.submitted > 0 && (first == 0 || r.submit_ns < first))
+				first = r.submit_ns;
+			if (r.start_ns > last)
+				last = r.start_ns;
+		} else if (r.type == REPORT_JOB && r.seq >= 0 && r.seq < njobs) {
+			dispatch[ndone] = r.start_ns - r.submit_ns;
+			complete[ndone] = r.end_ns - r.submit_ns;
+			if (r.end_ns > lastend)
+				lastend = r.end_ns;
+			ndone++;
+		}
+	}
+	while (wait(NULL) > 0)
+		;
+	close(fd);
+	unlink(report_path);
+
+	// 汇总
+	printf("submitted %d jobs from %d submitters (%d failed), %d completed\n",
+		submitted, nsubmit, failed, ndone);
+	if (submitted > 1 && last > first)
+		printf("submit rate     %10.1f jobs/s\n", (submitted - 1) / ((last - first) / 1e9));
+	if (ndone > 0 && lastend > t0)
+		printf("completion rate %10.1f jobs/s\n", ndone / ((lastend - t0) / 1e9));
+	if (ndone > 0) {
+		printf("\n%-20s %10s %10s %10s %10s %10s\n", "latency (ms)", "p50", "p90", "p99", "p99.9", "max");
+		percentiles("submit->dispatch", dispatch, ndone);
+		percentiles("submit->completion", complete, ndone);
+	}
+	return ndone == njobs ? 0 : 1;
+}
@@ -0,0 +1,505 @@
+/**
+ * @file policy.c
+ * @brief 调度核心实现
+ * @details 执行槽的就绪队列、作业窃取、老化和各调度算法。调度器和模拟器都链接本文件，
+ *          模拟器评估的就是调度器实际运行的代码
+ */
+
+#include <stdlib.h>     // calloc
+#include <string.h>     // memcpy
+#include "policy.h"     // 调度核心定义
+
+void error_sys(const char *msg);
+
+long clock_ms = 0;      // 调度时钟：调度器记账的累计时间（单位：毫秒）
+long mlfq_next_boost = MLFQ_BOOST_MS;   // 下次提升的调度时钟
+int mlfq_quantum[MLFQ_LEVELS] = { 10, 40, 160 };    // 多级反馈队列默认各级时间片
+struct agewheel agewheel;           // 等待老化提升优先级的作业
+
+// 调度算法函数指针
+struct waitqueue* (*jobselect)(void);
+// 就绪队列维护函数指针，就绪队列不含运行中的作业
+void (*jobinsert)(struct waitqueue *p, int preempted);
+void (*jobremove)(struct waitqueue *p);
+int jobbypri;           // 就绪队列是否按当前优先级组织，老化时需要重新入队
+
+struct runslot *slots;  // 执行槽数组
+int nslot = 1;          // 执行槽个数
+struct runslot *cur;    // 调度算法正在操作的执行槽
+
+struct policy policies[NPOLICY] = {
+	{ "HPF",  jobselect_HPF,  100, insert_HPF,  remove_HPF,   1 },
+	{ "FCFS", jobselect_FCFS, 100, insert_FCFS, remove_ready, 0 },
+	{ "SJF",  jobselect_SJF,  100, insert_SJF,  remove_SJF,   0 },
+	{ "RR",   jobselect_RR,   20,  insert_tail, remove_ready, 0 },
+	{ "HRRN", jobselect_HRRN, 100, insert_HRRN, remove_HRRN,  0 },
+	{ "MLFQ", jobselect_MLFQ, 10,  insert_MLFQ, remove_MLFQ,  0 },
+};
+
+/**
+ * @brief 选用调度算法
+ * @param p 调度算法表中的一项
+ */
+void policy_use(const struct policy *p)
+{
+	jobselect = p->select;
+	jobinsert = p->insert;
+	jobremove = p->remove;
+	jobbypri = p->bypri;
+}
+
+/**
+ * @brief 调度算法的默认时钟周期
+ * @param p 调度算法表中的一项
+ * @return 时钟周期（单位：毫秒），多级反馈队列取第0级的时间片
+ */
+int policy_quantum(const struct policy *p)
+{
+	return p->select == jobselect_MLFQ ? mlfq_quantum[0] : p->quantum;
+}
+
+/**
+ * @brief 创建执行槽
+ * @param n 执行槽个数
+ * @details 各槽不绑定CPU，多级反馈队列使用mlfq_quantum中的时间片
+ */
+void slots_init(int n)
+{
+	int i;
+
+	nslot = n;
+	if ((slots = calloc(nslot, sizeof(*slots))) == NULL)
+		error_sys("calloc failed");
+	for (i = 0; i < nslot; i++) {
+		slots[i].cpu = -1;
+		memcpy(slots[i].mlfq.quantum, mlfq_quantum, sizeof(mlfq_quantum));
+	}
+}
+
+/**
+ * @brief 为新作业选择执行槽
+ * @return 运行中和就绪的作业最少的执行槽
+ */
+struct runslot *slot_pick()
+{
+	struct runslot *sl = slots;
+	int i;
+
+	for (i = 1; i < nslot; i++)
+		if (slots[i].nready + (slots[i].current != NULL) <
+		    sl->nready + (sl->current != NULL))
+			sl = &slots[i];
+	return sl;
+}
+
+/**
+ * @brief 作业加入执行槽的就绪队列
+ * @param sl 执行槽
+ * @param p 作业节点
+ * @param preempted 非0表示放回运行中的作业
+ */
+void rq_insert(struct runslot *sl, struct waitqueue *p, int preempted)
+{
+	cur = sl;
+	(*jobinsert)(p, preempted);
+	sl->nready++;
+}
+
+/**
+ * @brief 作业离开执行槽的就绪队列
+ * @param sl 执行槽
+ * @param p 就绪队列中的作业节点
+ */
+void rq_remove(struct runslot *sl, struct waitqueue *p)
+{
+	cur = sl;
+	(*jobremove)(p);
+	sl->nready--;
+}
+
+/**
+ * @brief 按调度算法从执行槽的就绪队列中选出作业
+ * @param sl 执行槽
+ * @return 选中的作业，已离开就绪队列；队列为空时返回NULL
+ */
+struct waitqueue *rq_select(struct runslot *sl)
+{
+	struct waitqueue *p;
+
+	cur = sl;
+	if ((p = (*jobselect)()) != NULL)
+		sl->nready--;
+	return p;
+}
+
+/**
+ * @brief 为空闲的执行槽窃取作业
+ * @param sl 就绪队列为空的执行槽
+ * @return 窃取的作业，已迁移到sl；没有可窃取的作业时返回NULL
+ * @details 从就绪作业最多的执行槽中取出它按调度算法下一个要运行的作业，
+ *          由jobmigrate()把已创建的进程改绑到sl的CPU
+ */
+struct waitqueue *jobsteal(struct runslot *sl)
+{
+	struct runslot *victim = NULL;
+	struct waitqueue *p;
+	int i;
+
+	for (i = 0; i < nslot; i++)
+		if (slots[i].nready > 0 &&
+		    (victim == NULL || slots[i].nready > victim->nready))
+			victim = &slots[i];
+	if (victim == NULL || (p = rq_select(victim)) == NULL)
+		return NULL;
+
+	p->job->slot = sl - slots;
+	jobmigrate(p->job);
+	return p;
+}
+
+/**
+ * @brief 为执行槽选出下一个作业
+ * @param sl 执行槽
+ * @return 选中的作业，已离开就绪队列；自己的队列为空时窃取，都没有时返回NULL
+ * @details 返回时cur指向sl
+ */
+struct waitqueue *rq_next(struct runslot *sl)
+{
+	struct waitqueue *p;
+
+	p = rq_select(sl);
+	if (p == NULL && nslot > 1)
+		p = jobsteal(sl);
+	cur = sl;
+	return p;
+}
+
+/**
+ * @brief 为执行槽选择下一个作业并切换
+ * @param sl 执行槽，运行中的作业已放回就绪队列或已结束
+ */
+void dispatch(struct runslot *sl)
+{
+	sl->next = rq_next(sl);
+	jobswitch();
+}
+
+/**
+ * @brief 调度器核心函数
+ * @param elapsed 距上次调度经过的时间（单位：毫秒）
+ * @details 每个时钟周期调用一次：更新作业状态，为每个执行槽选择下一个要运行的作业
+ */
+void schedule(int elapsed)
+{
+	struct runslot *sl;
+
+	// 更新所有作业状态
+	updateall(elapsed);
+
+	for (sl = slots; sl < slots + nslot; sl++) {
+		// 运行中的作业放回就绪队列，与等待的作业一起参与选择
+		if (sl->current && sl->current->job->state == RUNNING)
+			rq_insert(sl, sl->current, 1);
+
+		// 选择下一个要运行的作业并切换
+		dispatch(sl);
+	}
+}
+
+/**
+ * @brief 作业下次老化提升优先级的时刻
+ * @param job 作业
+ * @return 调度时钟时刻（单位：毫秒）
+ * @details 等待超过1个老化周期后，每多等待一个周期优先级提升一级，
+ *          即等待时间达到(curpri - defpri + 2)个周期时提升到curpri + 1
+ */
+long promote_time(const struct jobinfo *job)
+{
+	return job->enq_time + (long)(job->curpri - job->defpri + 2) * AGING_MS;
+}
+
+/**
+ * @brief 新作业加入调度
+ * @param job 已填好作业ID、默认优先级和预计运行时间的作业
+ * @param sl 执行槽
+ * @details 初始化调度算法使用的字段，加入老化时间轮和执行槽的就绪队列
+ */
+void jobadmit(struct jobinfo *job, struct runslot *sl)
+{
+	job->curpri = job->defpri;
+	job->state = READY;
+	job->run_time = 0;
+	job->enq_time = clock_ms;
+	job->wait_time_hrrf = 0;
+	job->priority = 0;
+	job->remaining_time = mlfq_quantum[0];
+	job->boost_epoch = sl->mlfq.epoch;
+	job->heapidx = -1;
+	job->slot = sl - slots;
+	job->node.job = job;
+	job->rqnode.job = job;
+	job->agenode.job = job;
+	if (job->curpri < 3) {
+		job->promote_at = promote_time(job);
+		wheel_add(&agewheel, job);
+	}
+	rq_insert(sl, &job->node, 0);
+}
+
+/**
+ * @brief 老化：提升老化时间轮中到期作业的优先级
+ * @details 在调度时钟推进后调用。等待时间由入队时刻推算，不逐个更新；
+ *          只有到期的作业提升优先级，最高为3
+ */
+void jobage()
+{
+	struct jobinfo *job;
+	struct runslot *sl;
+
+	while ((job = wheel_expire(&agewheel, clock_ms)) != NULL) {
+		// 就绪队列按优先级组织时，先出队再以新优先级入队
+		sl = &slots[job->slot];
+		if (jobbypri && &job->node != sl->current)
+			rq_remove(sl, &job->node);
+		do
+			job->curpri++;
+		while (job->curpri < 3 && promote_time(job) <= clock_ms);
+		if (jobbypri && &job->node != sl->current)
+			rq_insert(sl, &job->node, 0);
+
+		if (job->curpri < 3) {
+			job->promote_at = promote_time(job);
+			wheel_add(&agewheel, job);
+		}
+		jobpublish(job);
+	}
+}
+
+/**
+ * @brief 高优先级优先(HPF)调度算法
+ * @return 选中的作业
+ * @details 选择当前优先级最高的作业，如果优先级相同则选择等待时间最长的作业；
+ *          就绪队列按优先级分桶，选择、入队和出队都是常数时间
+ */
+struct waitqueue* jobselect_HPF()
+{
+	struct jobinfo *selected = hpf_pop(&cur->hpfq);
+
+	return selected ? &selected->node : NULL;
+}
+
+/**
+ * @brief HPF就绪队列入队
+ * @param p 作业节点
+ * @param preempted 非0表示放回被抢占的作业
+ */
+void insert_HPF(struct waitqueue *p, int preempted)
+{
+	hpf_insert(&cur->hpfq, p->job, preempted);
+}
+
+/**
+ * @brief HPF就绪队列出队
+ * @param p 作业节点
+ */
+void remove_HPF(struct waitqueue *p)
+{
+	hpf_remove(&cur->hpfq, p->job);
+}
+
+/**
+ * @brief 先来先服务(FCFS)调度算法
+ * @return 选中的作业
+ * @details 选择等待时间最长的作业。等待时间从入队时刻算起，
+ *          就绪队列按到达顺序排列，队首即等待时间最长的作业
+ */
+struct waitqueue* jobselect_FCFS()
+{
+	struct waitqueue *p = queue_pop(&cur->readyq);
+
+	return p ? &p->job->node : NULL;
+}
+
+/**
+ * @brief FCFS就绪队列入队
+ * @param p 作业节点
+ * @param preempted 非0表示放回运行中的作业，它比所有等待的作业到达得早，放在队首
+ */
+void insert_FCFS(struct waitqueue *p, int preempted)
+{
+	if (preempted)
+		queue_pushfront(&cur->readyq, &p->job->rqnode);
+	else
+		queue_push(&cur->readyq, &p->job->rqnode);
+}
+
+/**
+ * @brief 作业加入就绪队列队尾
+ * @param p 作业节点
+ * @param preempted 未使用，放回的作业同样排到队尾；保留它是为了与jobinsert的类型一致
+ */
+void insert_tail(struct waitqueue *p, int preempted)
+{
+	(void)preempted;
+	queue_push(&cur->readyq, &p->job->rqnode);
+}
+
+/**
+ * @brief 作业离开就绪队列
+ * @param p 作业节点
+ */
+void remove_ready(struct waitqueue *p)
+{
+	queue_remove(&cur->readyq, &p->job->rqnode);
+}
+
+/**
+ * @brief 短作业优先(SJF)调度算法
+ * @return 选中的作业
+ * @details 选择预计运行时间最短的作业，运行时间相同时选择等待时间最长的作业；
+ *          运行中的作业每个时钟放回参与选择，更短的作业到达时会抢占它。
+ *          放回的作业与堆顶合并为一次入堆取顶，没有更短的作业时为常数时间
+ */
+struct waitqueue* jobselect_SJF()
+{
+	struct jobinfo *selected;
+
+	if (cur->sjf_held) {
+		selected = sjf_pushpop(&cur->sjfq, cur->sjf_held);
+		cur->sjf_held = NULL;
+	} else
+		selected = sjf_pop(&cur->sjfq);
+
+	return selected ? &selected->node : NULL;
+}
+
+/**
+ * @brief SJF就绪队列入队
+ * @param p 作业节点
+ * @param preempted 非0表示放回运行中的作业，暂存到下一次选择时再入堆
+ */
+void insert_SJF(struct waitqueue *p, int preempted)
+{
+	if (preempted)
+		cur->sjf_held = p->job;
+	else
+		sjf_insert(&cur->sjfq, p->job);
+}
+
+/**
+ * @brief SJF就绪队列出队
+ * @param p 作业节点
+ */
+void remove_SJF(struct waitqueue *p)
+{
+	sjf_remove(&cur->sjfq, p->job);
+}
+
+/**
+ * @brief 时间片轮转调度算法
+ * @return 选中的作业
+ * @details 选择队首作业；运行中的作业每个时钟放回队尾，轮转为常数时间
+ */
+struct waitqueue* jobselect_RR()
+{
+	struct waitqueue *p = queue_pop(&cur->readyq);
+
+	return p ? &p->job->node : NULL;
+}
+
+/**
+ * @brief 最高响应比优先调度算法
+ * @return 选中的作业
+ * @details 选择响应比（等待时间 + 预计运行时间）/ 预计运行时间最高的作业。
+ *          等待时间按调度时钟（单调时钟）计算，预计运行时间按毫秒计。
+ *          HRRN不抢占：运行中的作业放回后直接再次选中，直到它结束
+ */
+struct waitqueue* jobselect_HRRN()
+{
+	struct jobinfo *selected;
+
+	if (cur->hrrn_held) {
+		selected = cur->hrrn_held;
+		cur->hrrn_held = NULL;
+	} else
+		selected = hrrn_pop(&cur->hrrnq, clock_ms);
+
+	return selected ? &selected->node : NULL;
+}
+
+/**
+ * @brief HRRN就绪队列入队
+ * @param p 作业节点
+ * @param preempted 非0表示放回运行中的作业，暂存后在下一次选择时原样返回
+ */
+void insert_HRRN(struct waitqueue *p, int preempted)
+{
+	if (preempted)
+		cur->hrrn_held = p->job;
+	else
+		hrrn_insert(&cur->hrrnq, p->job);
+}
+
+/**
+ * @brief HRRN就绪队列出队
+ * @param p 作业节点
+ */
+void remove_HRRN(struct waitqueue *p)
+{
+	hrrn_remove(&cur->hrrnq, p->job);
+}
+
+/**
+ * @brief 多级反馈队列调度算法
+ * @return 选中的作业
+ * @details 总是选择最高非空级别的队首作业。新作业从第0级开始，
+ *          用完本级时间片后降一级，低级别的时间片更长；
+ *          每个提升周期把所有作业提升回第0级，防止低级别的作业饿死
+ */
+struct waitqueue* jobselect_MLFQ()
+{
+	struct jobinfo *selected;
+
+	int i;
+
+	// 所有执行槽同时提升，各槽的提升轮次保持一致，作业迁移后级别仍然有效
+	if (clock_ms >= mlfq_next_boost) {
+		for (i = 0; i < nslot; i++)
+			mlfq_boost(&slots[i].mlfq);
+		mlfq_next_boost = clock_ms + MLFQ_BOOST_MS;
+	}
+
+	selected = mlfq_pop(&cur->mlfq);
+	return selected ? &selected->node : NULL;
+}
+
+/**
+ * @brief 多级反馈队列入队
+ * @param p 作业节点
+ * @param preempted 非0表示放回运行中的作业：时间片用完时降一级排到队尾，
+ *                  否则放回本级队首，没有更高级别的作业时继续运行
+ */
+void insert_MLFQ(struct waitqueue *p, int preempted)
+{
+	struct jobinfo *job = p->job;
+	int lv = mlfq_level(&cur->mlfq, job);
+
+	if (preempted && job->remaining_time > 0) {
+		mlfq_insert(&cur->mlfq, job, 1);
+		return;
+	}
+	if (preempted && lv < MLFQ_LEVELS - 1)
+		job->priority = ++lv;
+	if (preempted)
+		job->remaining_time = cur->mlfq.quantum[lv];
+	mlfq_insert(&cur->mlfq, job, 0);
+}
+
+/**
+ * @brief 多级反馈队列出队
+ * @param p 作业节点
+ */
+void remove_MLFQ(struct waitqueue *p)
+{
+	mlfq_remove(&cur->mlfq, p->job);
+}
@@ -0,0 +1,99 @@
+/**
+ * @file policy.h
+ * @brief 调度核心：执行槽、就绪队列和各调度算法
+ * @details 调度器和模拟器共用同一份调度算法代码。调度核心只操作作业记录和就绪队列，
+ *          作业的启动、暂停、记账等由链接它的程序实现（见下面的执行器接口）：
+ *          调度器操作真实进程，模拟器推进虚拟时钟
+ */
+
+#ifndef _POLICY_H
+#define _POLICY_H
+
+#include "job.h"
+#include "queue.h"
+
+#define AGING_MS 1000       // 老化周期：等待超过一个周期后，每多等一个周期优先级提升一级
+#define MLFQ_BOOST_MS 1000  // 多级反馈队列的提升周期：每个周期把所有作业提升到最高级
+
+// 执行槽：同一时刻运行一个作业，拥有各算法的就绪队列，调度算法只操作cur所指的槽
+struct runslot {
+	int cpu;                            // 绑定的CPU，-1表示不绑定
+	struct waitqueue *current;          // 当前运行的作业
+	struct waitqueue *next;             // 下一个要运行的作业
+	int nready;                         // 就绪队列中的作业数
+	struct jobqueue readyq;             // FCFS、RR共用的就绪队列
+	struct mlfqueue mlfq;               // 多级反馈队列
+	struct hrrnqueue hrrnq;             // HRRN就绪队列
+	struct jobinfo *hrrn_held;          // 放回的运行中作业，HRRN不抢占
+	struct hpfqueue hpfq;               // HPF就绪队列
+	struct sjfheap sjfq;                // SJF就绪队列
+	struct jobinfo *sjf_held;           // 放回但尚未入堆的运行中作业
+};
+
+// 调度算法表，每种算法带有默认时间片
+struct policy {
+	const char *name;                   // 算法名称
+	struct waitqueue* (*select)(void);  // 作业选择函数
+	int quantum;                        // 默认时间片（单位：毫秒）
+	void (*insert)(struct waitqueue *p, int preempted); // 就绪队列入队
+	void (*remove)(struct waitqueue *p);                // 就绪队列出队
+	int bypri;                          // 就绪队列是否按当前优先级组织
+};
+
+#define NPOLICY 6
+
+extern struct policy policies[NPOLICY];
+extern long clock_ms;                   // 调度时钟：调度器记账的累计时间（单位：毫秒）
+extern long mlfq_next_boost;            // 下次提升的调度时钟
+extern int mlfq_quantum[MLFQ_LEVELS];   // 多级反馈队列默认各级时间片
+extern struct agewheel agewheel;        // 等待老化提升优先级的作业
+extern struct runslot *slots;           // 执行槽数组
+extern int nslot;                       // 执行槽个数
+extern struct runslot *cur;             // 调度算法正在操作的执行槽
+
+// 调度算法函数指针
+extern struct waitqueue* (*jobselect)(void);
+extern void (*jobinsert)(struct waitqueue *p, int preempted);
+extern void (*jobremove)(struct waitqueue *p);
+extern int jobbypri;
+
+void policy_use(const struct policy *p);
+int policy_quantum(const struct policy *p);
+void slots_init(int n);
+struct runslot *slot_pick(void);
+void rq_insert(struct runslot *sl, struct waitqueue *p, int preempted);
+void rq_remove(struct runslot *sl, struct waitqueue *p);
+struct waitqueue *rq_select(struct runslot *sl);
+struct waitqueue *jobsteal(struct runslot *sl);
+struct waitqueue *rq_next(struct runslot *sl);
+void dispatch(struct runslot *sl);
+void schedule(int elapsed);
+long promote_time(const struct jobinfo *job);
+void jobadmit(struct jobinfo *job, struct runslot *sl);
+void jobage(void);
+
+struct waitqueue* jobselect_HPF(void);
+struct waitqueue* jobselect_FCFS(void);
+struct waitqueue* jobselect_SJF(void);
+struct waitqueue* jobselect_RR(void);
+struct waitqueue* jobselect_HRRN(void);
+struct waitqueue* jobselect_MLFQ(void);
+void insert_HPF(struct waitqueue *p, int preempted);
+void remove_HPF(struct waitqueue *p);
+void insert_SJF(struct waitqueue *p, int preempted);
+void remove_SJF(struct waitqueue *p);
+void insert_HRRN(struct waitqueue *p, int preempted);
+void remove_HRRN(struct waitqueue *p);
+void insert_MLFQ(struct waitqueue *p, int preempted);
+void remove_MLFQ(struct waitqueue *p);
+void insert_FCFS(struct waitqueue *p, int preempted);
+void insert_tail(struct waitqueue *p, int preempted);
+void remove_ready(struct waitqueue *p);
+
+// 执行器接口：由链接调度核心的程序实现
+void updateall(int elapsed);            // 为运行中的作业记账，推进调度时钟后调用jobage()
+void jobswitch(void);                   // 在cur所指的执行槽上释放已结束的作业、切换到cur->next
+void jobmigrate(struct jobinfo *job);   // 作业被窃取到job->slot所指的执行槽
+void jobpublish(const struct jobinfo *job); // 作业的调度状态发生了变化
+
+#endif
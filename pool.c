@@ -0,0 +1,117 @@
+/**
+ * @file pool.c
+ * @brief 作业记录内存池实现
+ * @details 空闲的作业记录通过其作业链表节点串成单链表；空闲的参数区
+ *          复用自身的前几个字节串成链表。池中的内存不归还系统
+ */
+
+#include <stdlib.h>     // malloc、free
+#include "pool.h"       // 内存池定义
+
+void error_sys(const char *msg);
+
+// 参数区头部，记录所属级别，释放时据此放回对应的空闲链表
+struct blobhead {
+    size_t shift;               // 级别（容量的对数），0表示直接向系统申请
+    union {
+        struct blobhead *next;  // 空闲时指向下一个空闲参数区
+        max_align_t align;      // 保证参数区按最大对齐要求对齐
+    } u;
+};
+
+#define NBLOB (BLOB_MAXSHIFT - BLOB_MINSHIFT + 1)
+
+static struct jobinfo *freejobs = NULL;    // 空闲作业记录链表
+static struct blobhead *freeblobs[NBLOB];  // 各级空闲参数区链表
+static char *arena = NULL;                 // 当前切分的大块
+static size_t arena_left = 0;              // 大块中剩余的字节数
+
+/**
+ * @brief 分配一个作业记录
+ * @return 作业记录，内容未初始化
+ * @details 空闲链表为空时一次申请POOL_CHUNK个记录
+ */
+struct jobinfo *job_alloc()
+{
+	struct jobinfo *job, *chunk;
+	int i;
+
+	if (freejobs == NULL) {
+		if ((chunk = malloc(sizeof(*chunk) * POOL_CHUNK)) == NULL)
+			error_sys("malloc failed");
+		for (i = 0; i < POOL_CHUNK; i++)
+			job_release(&chunk[i]);
+	}
+
+	job = freejobs;
+	freejobs = (struct jobinfo *)job->node.next;
+	return job;
+}
+
+/**
+ * @brief 释放作业记录
+ * @param job 作业记录，不再位于任何队列中
+ */
+void job_release(struct jobinfo *job)
+{
+	job->node.next = (struct waitqueue *)freejobs;
+	freejobs = job;
+}
+
+/**
+ * @brief 分配参数区
+ * @param size 所需字节数
+ * @return 按最大对齐要求对齐的内存
+ * @details 容量向上取整到2的幂，优先从该级的空闲链表中取，
+ *          否则从当前大块中切出；超过最大级别时直接向系统申请
+ */
+void *blob_alloc(size_t size)
+{
+	struct blobhead *b;
+	size_t shift = BLOB_MINSHIFT, need;
+
+	while (shift <= BLOB_MAXSHIFT && ((size_t)1 << shift) < size)
+		shift++;
+
+	if (shift > BLOB_MAXSHIFT) {
+		if ((b = malloc(offsetof(struct blobhead, u) + size)) == NULL)
+			error_sys("malloc failed");
+		b->shift = 0;
+		return &b->u;
+	}
+
+	if ((b = freeblobs[shift - BLOB_MINSHIFT]) != NULL) {
+		freeblobs[shift - BLOB_MINSHIFT] = b->u.next;
+		return &b->u;
+	}
+
+	// 大块剩余空间不足时丢弃余下部分，另申请一块
+	need = offsetof(struct blobhead, u) + ((size_t)1 << shift);
+	need = (need + sizeof(max_align_t) - 1) & ~(sizeof(max_align_t) - 1);
+	if (arena_left < need) {
+		if ((arena = malloc(BLOB_ARENA)) == NULL)
+			error_sys("malloc failed");
+		arena_left = BLOB_ARENA;
+	}
+	b = (struct blobhead *)arena;
+	arena += need;
+	arena_left -= need;
+	b->shift = shift;
+	return &b->u;
+}
+
+/**
+ * @brief 释放参数区
+ * @param blob blob_alloc()返回的内存
+ */
+void blob_release(void *blob)
+{
+	struct blobhead *b = (struct blobhead *)((char *)blob - offsetof(struct blobhead, u));
+
+	if (b->shift == 0) {
+		free(b);
+		return;
+	}
+	b->u.next = freeblobs[b->shift - BLOB_MINSHIFT];
+	freeblobs[b->shift - BLOB_MINSHIFT] = b;
+}
@@ -0,0 +1,26 @@
+/**
+ * @file pool.h
+ * @brief 作业记录内存池
+ * @details 调度器长期运行，作业不断创建和销毁。作业记录从定长的块中分配，
+ *          参数区按2的幂分级，释放的内存挂在各自的空闲链表上原样复用，
+ *          分配和释放都只是几次指针操作，不会随作业数增长产生堆碎片
+ */
+
+#ifndef _POOL_H
+#define _POOL_H
+
+#include <stddef.h>
+#include "job.h"
+
+#define POOL_CHUNK 256          // 每次向系统申请的作业记录个数
+#define BLOB_MINSHIFT 6         // 最小参数区级别：64字节
+#define BLOB_MAXSHIFT 16        // 最大参数区级别：64KB，更大的参数区直接向系统申请
+#define BLOB_ARENA (256 << 10)  // 小参数区从256KB的大块中切分
+
+struct jobinfo *job_alloc(void);
+void job_release(struct jobinfo *job);
+
+void *blob_alloc(size_t size);
+void blob_release(void *blob);
+
+#endif
@@ -0,0 +1,215 @@
+/**
+ * @file proto.c
+ * @brief 调度器命令协议的编码与解码
+ * @details 客户端用编码函数拼装帧，调度器用解码函数从接收缓冲区中取出命令
+ */
+
+#include <unistd.h>      // 系统调用接口
+#include <string.h>      // 字符串处理函数
+#include <errno.h>       // 错误码
+#include <sys/file.h>    // flock
+#include <sys/socket.h>  // 控制套接字
+#include <sys/un.h>      // sockaddr_un
+#include "proto.h"       // 协议定义
+
+/**
+ * @brief 写入帧头
+ * @param buf 输出缓冲区，至少容纳一个帧头
+ * @param type 消息类型
+ * @param len 消息体长度
+ * @return 帧头长度
+ */
+size_t proto_head(char *buf, int type, uint32_t len)
+{
+	struct msghead head;
+
+	head.magic = PROTO_MAGIC;
+	head.version = PROTO_VERSION;
+	head.type = type;
+	head.len = len;
+	memcpy(buf, &head, sizeof(head));
+	return sizeof(head);
+}
+
+/**
+ * @brief 计算一条入队记录的编码长度
+ * @param argc 参数个数
+ * @param argv 参数数组
+ * @return 记录长度（字节）
+ */
+size_t proto_enqsize(int argc, char *const argv[])
+{
+	size_t len = sizeof(struct enqbody);
+	int i;
+
+	for (i = 0; i < argc; i++)
+		len += strlen(argv[i]) + 1;
+	return len;
+}
+
+/**
+ * @brief 编码一条入队记录
+ * @param buf 输出缓冲区，至少容纳proto_enqsize()字节
+ * @param owner 所有者ID
+ * @param defpri 默认优先级
+ * @param duration 预计运行时间
+ * @param argc 参数个数
+ * @param argv 参数数组
+ * @return 记录长度（字节）
+ */
+size_t proto_putenq(char *buf, int owner, int defpri, int duration,
+                    int argc, char *const argv[])
+{
+	struct enqbody body;
+	char *offset = buf + sizeof(body);
+	size_t n;
+	int i;
+
+	for (i = 0; i < argc; i++) {
+		n = strlen(argv[i]) + 1;
+		memcpy(offset, argv[i], n);
+		offset += n;
+	}
+
+	body.owner = owner;
+	body.defpri = defpri;
+	body.duration = duration;
+	body.argc = argc;
+	body.arglen = offset - buf - sizeof(body);
+	memcpy(buf, &body, sizeof(body));
+	return offset - buf;
+}
+
+/**
+ * @brief 把若干完整的帧写入FIFO
+ * @param fd FIFO写端
+ * @param buf 帧数据
+ * @param len 数据长度
+ * @return 0表示成功，-1表示失败
+ * @details 超过PIPE_BUF的数据会被内核拆成多次写入，写入期间其他客户端的帧可能插在
+ *          两次写入之间，调度器无法重新同步。所以不论长短，所有写者都先对FIFO加排他锁，
+ *          未能加锁时不写入
+ */
+int proto_send(int fd, const char *buf, size_t len)
+{
+	ssize_t n;
+	int ret = 0;
+
+	while (flock(fd, LOCK_EX) < 0)
+		if (errno != EINTR)
+			return -1;
+
+	while (len > 0) {
+		if ((n = write(fd, buf, len)) < 0) {
+			if (errno == EINTR)
+				continue;
+			ret = -1;
+			break;
+		}
+		buf += n;
+		len -= n;
+	}
+
+	flock(fd, LOCK_UN);
+	return ret;
+}
+
+/**
+ * @brief 解析帧头
+ * @param buf 接收缓冲区
+ * @param len 缓冲区中的字节数
+ * @param head 输出的帧头
+ * @return 1表示帧头有效，0表示数据不足，-1表示魔数、版本或长度非法
+ */
+int proto_parsehead(const char *buf, size_t len, struct msghead *head)
+{
+	if (len < sizeof(*head))
+		return 0;
+
+	memcpy(head, buf, sizeof(*head));
+	if (head->magic != PROTO_MAGIC || head->version != PROTO_VERSION ||
+	    head->len > PROTO_MAXBODY)
+		return -1;
+	return 1;
+}
+
+/**
+ * @brief 解析一条入队记录
+ * @param buf 记录起始位置
+ * @param len 可用字节数
+ * @param cmd 输出的命令，参数区指针指向buf内部
+ * @return 记录长度，-1表示记录不完整或参数区与参数个数不符
+ */
+long proto_parseenq(const char *buf, size_t len, struct jobcmd *cmd)
+{
+	struct enqbody body;
+	const char *args, *end;
+	uint32_t n = 0;
+
+	if (len < sizeof(body))
+		return -1;
+	memcpy(&body, buf, sizeof(body));
+	if (body.argc == 0 || body.arglen > len - sizeof(body))
+		return -1;
+
+	// 参数区必须恰好由argc个以'\0'结尾的字符串组成
+	args = buf + sizeof(body);
+	for (end = args; end < args + body.arglen; end++)
+		if (*end == '\0')
+			n++;
+	if (n != body.argc || args[body.arglen - 1] != '\0')
+		return -1;
+
+	memset(cmd, 0, sizeof(*cmd));
+	cmd->type = ENQ;
+	cmd->owner = body.owner;
+	cmd->defpri = body.defpri;
+	cmd->duration = body.duration;
+	cmd->argnum = body.argc;
+	cmd->args = args;
+	cmd->arglen = body.arglen;
+	return sizeof(body) + body.arglen;
+}
+
+/**
+ * @brief 连接调度器的控制套接字
+ * @return 套接字，调度器未提供控制套接字时返回-1，调用者可退回到FIFO
+ */
+int proto_connect()
+{
+	struct sockaddr_un addr;
+	int fd;
+
+	if ((fd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0)) < 0)
+		return -1;
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strncpy(addr.sun_path, PROTO_SOCK, sizeof(addr.sun_path) - 1);
+	if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+		close(fd);
+		return -1;
+	}
+	return fd;
+}
+
+/**
+ * @brief 从控制套接字读取一个应答帧
+ * @param fd 控制套接字
+ * @param buf 接收缓冲区，至少PROTO_MAXMSG字节
+ * @param cap 缓冲区大小
+ * @param rep 输出的应答
+ * @return 应答之后附带的数据在buf中的偏移，-1表示连接断开或应答非法
+ */
+long proto_recvreply(int fd, char *buf, size_t cap, struct replybody *rep)
+{
+	struct msghead head;
+	ssize_t n;
+
+	while ((n = recv(fd, buf, cap, 0)) < 0 && errno == EINTR)
+		;
+	if (n <= 0 || proto_parsehead(buf, n, &head) != 1 || head.type != MSG_REPLY ||
+	    head.len != n - sizeof(head) || head.len < sizeof(*rep))
+		return -1;
+	memcpy(rep, buf + sizeof(head), sizeof(*rep));
+	return sizeof(head) + sizeof(*rep);
+}
@@ -0,0 +1,127 @@
+/**
+ * @file proto.h
+ * @brief 调度器命令协议
+ * @details 客户端与调度器之间的二进制帧格式：每帧由定长帧头和变长消息体组成，
+ *          帧头带魔数、版本号、消息类型和消息体长度。双方运行在同一台主机上，
+ *          所有整数均使用本机字节序。
+ *          帧可以写入单向的FIFO，也可以发到SOCK_SEQPACKET控制套接字：套接字上每条消息
+ *          恰好是一帧，调度器按请求的顺序对每个请求回复一个或多个应答帧，客户端可以
+ *          保持连接并连续发送多个请求，再按顺序读取应答
+ */
+
+#ifndef _PROTO_H
+#define _PROTO_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "job.h"
+
+#define PROTO_MAGIC    0x4a42        // 帧头魔数
+#define PROTO_VERSION  1             // 协议版本
+#define PROTO_MAXBODY  (16 << 20)    // 消息体长度上限（16MB）
+#define PROTO_SOCK     "/tmp/jobsock"   // 控制套接字路径
+#define PROTO_MAXMSG   (64 << 10)    // 控制套接字上单条消息（含帧头）的长度上限
+#define PROTO_WINDOW   64            // 客户端连续发送、尚未收到应答的请求数上限
+
+// 消息类型，单条命令与job.h中的命令类型一致
+#define MSG_ENQ    ENQ     // 单个作业入队
+#define MSG_DEQ    DEQ     // 作业出队
+#define MSG_STAT   STAT    // 状态查询
+#define MSG_ENQBATCH 4     // 批量入队（MSG_BATCH已是套接字标志）
+#define MSG_REPLY  5       // 应答，只出现在控制套接字上
+#define MSG_LATENCY 6      // 延迟统计查询，消息体为空
+
+// 帧头
+struct msghead {
+    uint16_t magic;         // 魔数
+    uint8_t  version;       // 协议版本
+    uint8_t  type;          // 消息类型
+    uint32_t len;           // 消息体长度，不含帧头
+};
+
+// 入队记录，后接arglen字节的参数区：argc个依次排列、以'\0'结尾的字符串
+struct enqbody {
+    int32_t  owner;         // 所有者ID
+    int32_t  defpri;        // 默认优先级
+    int32_t  duration;      // 预计运行时间
+    uint32_t argc;          // 参数个数，argv[0]为可执行文件
+    uint32_t arglen;        // 参数区长度
+};
+
+#define PROTO_ENQMIN   (sizeof(struct enqbody) + 1)   // 最短的入队记录：一个空字符串参数
+
+// 出队消息体
+struct deqbody {
+    int32_t  owner;         // 所有者ID
+    int32_t  jid;           // 作业ID
+};
+
+// 状态查询消息体
+struct statbody {
+    int32_t  owner;         // 所有者ID
+};
+
+// 批量入队消息体为一个uint32_t记录数，后接相应个数的入队记录，记录之后不能有多余的字节
+
+// 应答消息体，状态查询的应答后接count个statrow
+struct replybody {
+    int32_t  status;        // 0表示成功，否则为errno错误码
+    int32_t  jid;           // 入队：第一个新作业的ID，出队：被终止的作业ID
+    uint32_t count;         // 入队：新作业个数，作业ID连续；状态查询：本帧中的作业数
+    uint32_t more;          // 非0表示本请求还有后续应答帧
+};
+
+// 状态查询应答中的一个作业
+struct statrow {
+    int32_t  jid;           // 作业ID
+    int32_t  pid;           // 进程ID
+    int32_t  owner;         // 所有者ID
+    int32_t  run_time;      // 已使用的CPU时间（单位：毫秒）
+    int32_t  state;         // 作业状态
+    int32_t  defpri;        // 默认优先级
+    int32_t  curpri;        // 当前优先级
+    int32_t  pad;
+    int64_t  wait_time;     // 等待时间（单位：毫秒）
+    int64_t  create_time;   // 创建时间
+};
+
+// 延迟指标
+#define LAT_QUEUE      0    // 排队时间：在就绪队列中等待的总时间（单位：微秒）
+#define LAT_RESPONSE   1    // 响应时间：从提交到首次运行（单位：微秒）
+#define LAT_TURNAROUND 2    // 周转时间：从提交到结束（单位：微秒）
+#define LAT_SLOWDOWN   3    // 减速比：周转时间与使用的CPU时间（至少10ms）之比，最小为1（单位：千分之一）
+#define LAT_NMETRIC    4
+#define LAT_ALLOWNERS  (-1) // 统计全部作业的行的所有者ID
+#define LAT_MAXOWNERS  64   // 单独统计的所有者个数上限，其余只计入全部作业
+
+// 延迟统计查询的应答为一帧：应答消息体、char policy[16]调度算法名称，后接count个latrow；
+// 只统计正常结束或被信号终止的作业，出队的作业不计入
+struct latrow {
+    int32_t  owner;         // 所有者ID，LAT_ALLOWNERS表示全部作业
+    int32_t  metric;        // 延迟指标
+    uint64_t count;         // 作业数
+    uint64_t p50;           // 中位数
+    uint64_t p99;           // 99百分位
+    uint64_t p999;          // 99.9百分位
+    uint64_t max;           // 最大值
+};
+
+#define LAT_POLICYLEN 16
+
+#define STATROWS_PER_MSG ((PROTO_MAXMSG - sizeof(struct msghead) - sizeof(struct replybody)) \
+                          / sizeof(struct statrow))
+
+// 编码
+size_t proto_head(char *buf, int type, uint32_t len);
+size_t proto_enqsize(int argc, char *const argv[]);
+size_t proto_putenq(char *buf, int owner, int defpri, int duration,
+                    int argc, char *const argv[]);
+int proto_send(int fd, const char *buf, size_t len);
+int proto_connect(void);
+
+// 解码
+int proto_parsehead(const char *buf, size_t len, struct msghead *head);
+long proto_parseenq(const char *buf, size_t len, struct jobcmd *cmd);
+long proto_recvreply(int fd, char *buf, size_t cap, struct replybody *rep);
+
+#endif
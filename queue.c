@@ -0,0 +1,674 @@
+/**
+ * @file queue.c
+ * @brief 就绪队列数据结构实现
+ * @details 作业队列、老化时间轮、HPF队列和多级反馈队列的操作都是常数时间，
+ *          作业索引的操作期望为常数时间；
+ *          HRRN队列的入队和出队为常数时间，选择最多检查HRRN_NCLASS个队首；
+ *          SJF堆的入队和出队为对数时间，查看堆顶为常数时间
+ */
+
+#include <stddef.h>     // NULL
+#include <stdint.h>     // 定长整数类型
+#include <stdlib.h>     // realloc
+#include "queue.h"      // 就绪队列定义
+
+void error_sys(const char *msg);
+
+/**
+ * @brief 节点加入队尾
+ * @param q 作业队列
+ * @param p 节点
+ */
+void queue_push(struct jobqueue *q, struct waitqueue *p)
+{
+	p->next = NULL;
+	p->prev = q->tail;
+	if (q->tail)
+		q->tail->next = p;
+	else
+		q->head = p;
+	q->tail = p;
+	q->count++;
+}
+
+/**
+ * @brief 节点加入队首
+ * @param q 作业队列
+ * @param p 节点
+ */
+void queue_pushfront(struct jobqueue *q, struct waitqueue *p)
+{
+	p->prev = NULL;
+	p->next = q->head;
+	if (q->head)
+		q->head->prev = p;
+	else
+		q->tail = p;
+	q->head = p;
+	q->count++;
+}
+
+/**
+ * @brief 节点插入到队列中指定节点之后
+ * @param q 作业队列
+ * @param pos 队列中的节点，NULL表示插入到队首
+ * @param p 节点
+ */
+void queue_insertafter(struct jobqueue *q, struct waitqueue *pos, struct waitqueue *p)
+{
+	if (pos == NULL) {
+		queue_pushfront(q, p);
+		return;
+	}
+	p->prev = pos;
+	p->next = pos->next;
+	if (pos->next)
+		pos->next->prev = p;
+	else
+		q->tail = p;
+	pos->next = p;
+	q->count++;
+}
+
+/**
+ * @brief 从队列中删除任意节点
+ * @param q 作业队列
+ * @param p 队列中的节点
+ */
+void queue_remove(struct jobqueue *q, struct waitqueue *p)
+{
+	if (p->prev)
+		p->prev->next = p->next;
+	else
+		q->head = p->next;
+	if (p->next)
+		p->next->prev = p->prev;
+	else
+		q->tail = p->prev;
+	p->prev = p->next = NULL;
+	q->count--;
+}
+
+/**
+ * @brief 把一个队列整体接到另一个队列的队尾
+ * @param q 目标队列
+ * @param from 源队列，返回时为空
+ */
+void queue_splice(struct jobqueue *q, struct jobqueue *from)
+{
+	if (from->head == NULL)
+		return;
+	if (q->tail) {
+		q->tail->next = from->head;
+		from->head->prev = q->tail;
+	} else
+		q->head = from->head;
+	q->tail = from->tail;
+	q->count += from->count;
+	from->head = from->tail = NULL;
+	from->count = 0;
+}
+
+/**
+ * @brief 取出队首节点
+ * @param q 作业队列
+ * @return 队首节点，队列为空时返回NULL
+ */
+struct waitqueue *queue_pop(struct jobqueue *q)
+{
+	struct waitqueue *p = q->head;
+
+	if (p)
+		queue_remove(q, p);
+	return p;
+}
+
+/**
+ * @brief 计算键在索引中的初始槽位
+ * @details 乘法散列取高位，连续分配的作业ID和进程号也能均匀分布
+ */
+static uint32_t index_hash(const struct jobindex *ix, int key)
+{
+	return ((uint32_t)key * 0x9E3779B1u) >> (32 - ix->bits);
+}
+
+/**
+ * @brief 扩大索引并重新放置所有作业
+ * @param ix 作业索引
+ */
+static void index_grow(struct jobindex *ix)
+{
+	struct jobslot *old = ix->slots;
+	int i, n = ix->slots ? 1 << ix->bits : 0;
+
+	ix->bits = ix->slots ? ix->bits + 1 : 6;
+	ix->slots = calloc((size_t)1 << ix->bits, sizeof(*ix->slots));
+	if (ix->slots == NULL)
+		error_sys("calloc failed");
+	ix->count = 0;
+	for (i = 0; i < n; i++)
+		if (old[i].job)
+			index_insert(ix, old[i].key, old[i].job);
+	free(old);
+}
+
+/**
+ * @brief 作业加入索引
+ * @param ix 作业索引
+ * @param key 键，索引中不能已有相同的键
+ * @param job 作业
+ */
+void index_insert(struct jobindex *ix, int key, struct jobinfo *job)
+{
+	uint32_t i, mask;
+
+	// 装载因子保持在1/2以下，探测序列很短
+	if (ix->slots == NULL || (ix->count + 1) * 2 > 1 << ix->bits)
+		index_grow(ix);
+
+	mask = (1u << ix->bits) - 1;
+	for (i = index_hash(ix, key); ix->slots[i].job; i = (i + 1) & mask)
+		;
+	ix->slots[i].key = key;
+	ix->slots[i].job = job;
+	ix->count++;
+}
+
+/**
+ * @brief 按键查找作业
+ * @param ix 作业索引
+ * @param key 键
+ * @return 作业，找不到时返回NULL
+ */
+struct jobinfo *index_find(struct jobindex *ix, int key)
+{
+	uint32_t i, mask;
+
+	if (ix->slots == NULL)
+		return NULL;
+
+	mask = (1u << ix->bits) - 1;
+	for (i = index_hash(ix, key); ix->slots[i].job; i = (i + 1) & mask)
+		if (ix->slots[i].key == key)
+			return ix->slots[i].job;
+	return NULL;
+}
+
+/**
+ * @brief 从索引中删除作业
+ * @param ix 作业索引
+ * @param key 键，不在索引中时什么也不做
+ * @details 删除后把同一探测序列上的后续元素前移填补空槽，不需要墓碑
+ */
+void index_remove(struct jobindex *ix, int key)
+{
+	uint32_t i, j, home, mask;
+
+	if (ix->slots == NULL)
+		return;
+
+	mask = (1u << ix->bits) - 1;
+	for (i = index_hash(ix, key); ix->slots[i].job; i = (i + 1) & mask)
+		if (ix->slots[i].key == key)
+			break;
+	if (ix->slots[i].job == NULL)
+		return;
+
+	for (j = (i + 1) & mask; ix->slots[j].job; j = (j + 1) & mask) {
+		// 初始槽位落在(i, j]之间的元素不能移到i处
+		home = index_hash(ix, ix->slots[j].key);
+		if (((j - home) & mask) < ((j - i) & mask))
+			continue;
+		ix->slots[i] = ix->slots[j];
+		i = j;
+	}
+	ix->slots[i].job = NULL;
+	ix->count--;
+}
+
+/**
+ * @brief 作业加入老化时间轮
+ * @param w 时间轮
+ * @param job 作业，promote_at不能早于已检查过的槽
+ * @details 槽内按(到期时刻, 作业ID)排序。作业大多按到达顺序加入，从队尾向前找插入位置通常是常数时间
+ */
+void wheel_add(struct agewheel *w, struct jobinfo *job)
+{
+	struct jobqueue *q = &w->slot[job->promote_at / WHEEL_MS % WHEEL_SLOTS];
+	struct waitqueue *pos = q->tail;
+
+	while (pos != NULL && (pos->job->promote_at > job->promote_at ||
+	       (pos->job->promote_at == job->promote_at && pos->job->jid > job->jid)))
+		pos = pos->prev;
+	queue_insertafter(q, pos, &job->agenode);
+	w->count++;
+}
+
+/**
+ * @brief 作业离开老化时间轮
+ * @param w 时间轮
+ * @param job 时间轮中的作业
+ */
+void wheel_remove(struct agewheel *w, struct jobinfo *job)
+{
+	queue_remove(&w->slot[job->promote_at / WHEEL_MS % WHEEL_SLOTS], &job->agenode);
+	w->count--;
+}
+
+/**
+ * @brief 取出一个已到期的作业
+ * @param w 时间轮
+ * @param now 当前时刻（单位：毫秒）
+ * @return 到期的作业，已离开时间轮；没有到期的作业时返回NULL
+ * @details 逐槽推进到当前时刻所在的槽，当前槽中尚未到期的作业留到下次。
+ *          槽内已按(到期时刻, 作业ID)排序，只需检查队首，保证先到达的作业先提升；
+ *          同一槽中有大量作业同时到期时，取出每个作业也是常数时间
+ */
+struct jobinfo *wheel_expire(struct agewheel *w, long now)
+{
+	struct jobqueue *q;
+	struct waitqueue *p;
+
+	for (;;) {
+		q = &w->slot[w->cursor % WHEEL_SLOTS];
+		if ((p = q->head) != NULL && p->job->promote_at <= now) {
+			queue_remove(q, p);
+			w->count--;
+			return p->job;
+		}
+		if (w->cursor >= now / WHEEL_MS)
+			return NULL;
+		w->cursor++;
+	}
+}
+
+/**
+ * @brief 作业加入HPF就绪队列
+ * @param q 就绪队列
+ * @param job 作业，按其当前优先级和默认优先级入桶
+ * @param front 非0时放在桶首，用于放回被抢占的作业：它被选中时是同一默认
+ *              优先级中到达最早的作业，之后到达的作业都排在它后面
+ */
+void hpf_insert(struct hpfqueue *q, struct jobinfo *job, int front)
+{
+	int cur = job->curpri, def = job->defpri;
+
+	if (front)
+		queue_pushfront(&q->bucket[cur][def], &job->rqnode);
+	else
+		queue_push(&q->bucket[cur][def], &job->rqnode);
+
+	q->mask[cur] |= 1u << def;
+	q->levels |= 1u << cur;
+	q->count++;
+}
+
+/**
+ * @brief 作业离开HPF就绪队列
+ * @param q 就绪队列
+ * @param job 队列中的作业，其优先级必须与入队时一致
+ */
+void hpf_remove(struct hpfqueue *q, struct jobinfo *job)
+{
+	int cur = job->curpri, def = job->defpri;
+
+	queue_remove(&q->bucket[cur][def], &job->rqnode);
+	if (q->bucket[cur][def].count == 0) {
+		q->mask[cur] &= ~(1u << def);
+		if (q->mask[cur] == 0)
+			q->levels &= ~(1u << cur);
+	}
+	q->count--;
+}
+
+/**
+ * @brief 取出当前优先级最高的作业
+ * @param q 就绪队列
+ * @return 选中的作业，队列为空时返回NULL
+ * @details 优先级相同时选择等待时间最长的作业，即作业ID最小（最先到达）的作业
+ */
+struct jobinfo *hpf_pop(struct hpfqueue *q)
+{
+	struct jobinfo *p, *selected = NULL;
+	unsigned int mask;
+	int cur, def;
+
+	if (q->levels == 0)
+		return NULL;
+
+	cur = 31 - __builtin_clz(q->levels);
+	for (mask = q->mask[cur]; mask != 0; mask &= mask - 1) {
+		def = __builtin_ctz(mask);
+		p = q->bucket[cur][def].head->job;
+		if (selected == NULL || p->jid < selected->jid)
+			selected = p;
+	}
+
+	hpf_remove(q, selected);
+	return selected;
+}
+
+/**
+ * @brief 作业当前所在的级别
+ * @param q 多级反馈队列
+ * @param job 作业
+ * @return 级别
+ * @details 作业的提升轮次落后时说明它已被整体提升到第0级，此时修正级别并给予新的时间片
+ */
+int mlfq_level(struct mlfqueue *q, struct jobinfo *job)
+{
+	if (job->boost_epoch != q->epoch) {
+		job->boost_epoch = q->epoch;
+		job->priority = 0;
+		job->remaining_time = q->quantum[0];
+	}
+	return job->priority;
+}
+
+/**
+ * @brief 作业加入多级反馈队列
+ * @param q 多级反馈队列
+ * @param job 作业，加入其级别对应的队列
+ * @param front 非0时放在队首，用于放回时间片未用完的作业
+ */
+void mlfq_insert(struct mlfqueue *q, struct jobinfo *job, int front)
+{
+	int lv = mlfq_level(q, job);
+
+	if (front)
+		queue_pushfront(&q->level[lv], &job->rqnode);
+	else
+		queue_push(&q->level[lv], &job->rqnode);
+	q->mask |= 1u << lv;
+	q->count++;
+}
+
+/**
+ * @brief 作业离开多级反馈队列
+ * @param q 多级反馈队列
+ * @param job 队列中的作业
+ */
+void mlfq_remove(struct mlfqueue *q, struct jobinfo *job)
+{
+	int lv = mlfq_level(q, job);
+
+	queue_remove(&q->level[lv], &job->rqnode);
+	if (q->level[lv].count == 0)
+		q->mask &= ~(1u << lv);
+	q->count--;
+}
+
+/**
+ * @brief 取出最高非空级别的队首作业
+ * @param q 多级反馈队列
+ * @return 选中的作业，队列为空时返回NULL
+ */
+struct jobinfo *mlfq_pop(struct mlfqueue *q)
+{
+	struct jobinfo *job;
+
+	if (q->mask == 0)
+		return NULL;
+
+	job = q->level[__builtin_ctz(q->mask)].head->job;
+	mlfq_remove(q, job);
+	return job;
+}
+
+/**
+ * @brief 把所有作业提升到第0级
+ * @param q 多级反馈队列
+ * @details 各级队列按级别顺序整体接到第0级队尾，不逐个访问作业；
+ *          提升轮次加1，作业的级别在下次用到时由mlfq_level()修正
+ */
+void mlfq_boost(struct mlfqueue *q)
+{
+	int lv;
+
+	for (lv = 1; lv < MLFQ_LEVELS; lv++)
+		queue_splice(&q->level[0], &q->level[lv]);
+	q->mask = q->level[0].count ? 1u : 0;
+	q->epoch++;
+}
+
+/**
+ * @brief 预计运行时间所在的级别
+ * @param duration 预计运行时间
+ * @return 级别
+ */
+static int hrrn_class(int duration)
+{
+	int e;
+
+	if (duration < HRRN_SUB)
+		return duration > 0 ? duration : 0;
+	if (duration >> HRRN_MAXBITS)
+		return HRRN_NCLASS - 1;
+	e = 31 - __builtin_clz(duration);
+	return HRRN_SUB + (e - HRRN_SUBBITS) * HRRN_SUB + (duration >> (e - HRRN_SUBBITS)) - HRRN_SUB;
+}
+
+/**
+ * @brief 作业加入HRRN就绪队列
+ * @param q 就绪队列
+ * @param job 作业，加入其运行时间所在级别的队尾
+ */
+void hrrn_insert(struct hrrnqueue *q, struct jobinfo *job)
+{
+	int c = hrrn_class(job->duration);
+
+	queue_push(&q->level[c], &job->rqnode);
+	q->mask[c / 64] |= 1ULL << (c % 64);
+	q->count++;
+}
+
+/**
+ * @brief 作业离开HRRN就绪队列
+ * @param q 就绪队列
+ * @param job 队列中的作业
+ */
+void hrrn_remove(struct hrrnqueue *q, struct jobinfo *job)
+{
+	int c = hrrn_class(job->duration);
+
+	queue_remove(&q->level[c], &job->rqnode);
+	if (q->level[c].count == 0)
+		q->mask[c / 64] &= ~(1ULL << (c % 64));
+	q->count--;
+}
+
+/**
+ * @brief 取出响应比最高的作业
+ * @param q 就绪队列
+ * @param now 当前时刻，与作业的入队时刻同一时钟（单位：毫秒）
+ * @return 选中的作业，队列为空时返回NULL
+ * @details 响应比为1 + 等待时间 / 运行时间，比较等待时间与运行时间之比即可。
+ *          两个比值用64位整数交叉相乘比较，没有浮点误差；运行时间为0的作业按1毫秒计，
+ *          不会除零，等价于最短的作业。响应比相同时选择先到达的作业。
+ *          同级作业中只看等待最久的队首，它与同级其他作业的运行时间相差不超过1/HRRN_SUB
+ */
+struct jobinfo *hrrn_pop(struct hrrnqueue *q, long now)
+{
+	struct jobinfo *p, *selected = NULL;
+	int64_t w, ws = 0, s, ss = 1;
+	uint64_t bits;
+	int i;
+
+	for (i = 0; i < HRRN_WORDS; i++) {
+		for (bits = q->mask[i]; bits != 0; bits &= bits - 1) {
+			p = q->level[i * 64 + __builtin_ctzll(bits)].head->job;
+			w = now - p->enq_time;
+			s = p->duration > 0 ? p->duration : 1;
+			if (selected == NULL || w * ss > ws * s ||
+			    (w * ss == ws * s && p->jid < selected->jid)) {
+				selected = p;
+				ws = w;
+				ss = s;
+			}
+		}
+	}
+
+	if (selected)
+		hrrn_remove(q, selected);
+	return selected;
+}
+
+/**
+ * @brief 作业预计还需的运行时间
+ * @details 预计运行时间减去已使用的CPU时间。只有运行中的作业的CPU时间会增加，
+ *          而它不在堆中，所以堆中作业的键不会变化
+ */
+static int sjf_left(const struct jobinfo *job)
+{
+	return job->duration > job->run_time ? job->duration - job->run_time : 0;
+}
+
+/**
+ * @brief 比较SJF堆中两个作业的先后
+ * @return 非0表示a应排在b前面
+ */
+static int sjf_before(const struct jobinfo *a, const struct jobinfo *b)
+{
+	if (sjf_left(a) != sjf_left(b))
+		return sjf_left(a) < sjf_left(b);
+	return a->jid < b->jid;
+}
+
+/**
+ * @brief 把作业放到堆中下标i处并记录下标
+ */
+static void sjf_place(struct sjfheap *h, int i, struct jobinfo *job)
+{
+	h->jobs[i] = job;
+	job->heapidx = i;
+}
+
+/**
+ * @brief 上浮调整
+ * @param h 堆
+ * @param i 起始下标
+ */
+static void sjf_siftup(struct sjfheap *h, int i)
+{
+	struct jobinfo *job = h->jobs[i];
+	int parent;
+
+	while (i > 0) {
+		parent = (i - 1) / SJF_ARITY;
+		if (!sjf_before(job, h->jobs[parent]))
+			break;
+		sjf_place(h, i, h->jobs[parent]);
+		i = parent;
+	}
+	sjf_place(h, i, job);
+}
+
+/**
+ * @brief 下沉调整
+ * @param h 堆
+ * @param i 起始下标
+ */
+static void sjf_siftdown(struct sjfheap *h, int i)
+{
+	struct jobinfo *job = h->jobs[i];
+	int child, best, end;
+
+	for (;;) {
+		child = i * SJF_ARITY + 1;
+		if (child >= h->count)
+			break;
+		end = child + SJF_ARITY < h->count ? child + SJF_ARITY : h->count;
+		for (best = child++; child < end; child++)
+			if (sjf_before(h->jobs[child], h->jobs[best]))
+				best = child;
+		if (!sjf_before(h->jobs[best], job))
+			break;
+		sjf_place(h, i, h->jobs[best]);
+		i = best;
+	}
+	sjf_place(h, i, job);
+}
+
+/**
+ * @brief 作业加入SJF堆
+ * @param h 堆
+ * @param job 作业
+ */
+void sjf_insert(struct sjfheap *h, struct jobinfo *job)
+{
+	if (h->count == h->cap) {
+		h->cap = h->cap ? h->cap * 2 : 64;
+		h->jobs = realloc(h->jobs, sizeof(*h->jobs) * h->cap);
+		if (h->jobs == NULL)
+			error_sys("realloc failed");
+	}
+	sjf_place(h, h->count++, job);
+	sjf_siftup(h, h->count - 1);
+}
+
+/**
+ * @brief 从SJF堆中删除任意作业
+ * @param h 堆
+ * @param job 堆中的作业
+ */
+void sjf_remove(struct sjfheap *h, struct jobinfo *job)
+{
+	int i = job->heapidx;
+	struct jobinfo *last = h->jobs[--h->count];
+
+	job->heapidx = -1;
+	if (i == h->count)
+		return;
+
+	// 用最后一个作业填补空位，再按需要上浮或下沉
+	sjf_place(h, i, last);
+	if (i > 0 && sjf_before(last, h->jobs[(i - 1) / SJF_ARITY]))
+		sjf_siftup(h, i);
+	else
+		sjf_siftdown(h, i);
+}
+
+/**
+ * @brief 查看预计运行时间最短的作业
+ * @param h 堆
+ * @return 堆顶作业，堆为空时返回NULL
+ */
+struct jobinfo *sjf_peek(struct sjfheap *h)
+{
+	return h->count ? h->jobs[0] : NULL;
+}
+
+/**
+ * @brief 取出预计运行时间最短的作业
+ * @param h 堆
+ * @return 堆顶作业，堆为空时返回NULL
+ */
+struct jobinfo *sjf_pop(struct sjfheap *h)
+{
+	struct jobinfo *job = sjf_peek(h);
+
+	if (job)
+		sjf_remove(h, job);
+	return job;
+}
+
+/**
+ * @brief 作业入堆后立即取出堆顶
+ * @param h 堆
+ * @param job 要入堆的作业
+ * @return 入堆后的堆顶作业
+ * @details 作业排在堆顶之前时直接返回它，堆不变，为常数时间；
+ *          否则用它替换堆顶并下沉，只需一次对数时间的调整
+ */
+struct jobinfo *sjf_pushpop(struct sjfheap *h, struct jobinfo *job)
+{
+	struct jobinfo *top = sjf_peek(h);
+
+	if (top == NULL || sjf_before(job, top))
+		return job;
+
+	top->heapidx = -1;
+	sjf_place(h, 0, job);
+	sjf_siftdown(h, 0);
+	return top;
+}
@@ -0,0 +1,123 @@
+/**
+ * @file queue.h
+ * @brief 就绪队列数据结构
+ * @details 各调度算法使用的就绪队列。队列只保存等待运行的作业，
+ *          正在运行的作业在调度时由调度器放回队列，再与其他作业一起参与选择。
+ *          链表类队列都使用job.h中的jobqueue，节点嵌入在作业结构体中
+ */
+
+#ifndef _QUEUE_H
+#define _QUEUE_H
+
+#include "job.h"
+
+#define NPRI 4      // 优先级级数（0-3）
+
+// HPF就绪队列：按[当前优先级][默认优先级]分桶的先进先出链表，位图记录非空的桶。
+// 默认优先级相同的作业按到达顺序老化提升，所以每个桶内始终按到达顺序排列；
+// 同一当前优先级下至多比较4个桶的队首即可找到等待时间最长的作业
+struct hpfqueue {
+    struct jobqueue bucket[NPRI][NPRI]; // 各桶
+    unsigned int levels;                // 非空的当前优先级位图
+    unsigned int mask[NPRI];            // 各当前优先级下非空的默认优先级位图
+    int count;                          // 队列中的作业数
+};
+
+// SJF就绪队列：按(预计剩余运行时间, 作业ID)排序的4叉小顶堆，作业记录自己在堆中的下标。
+// 作业ID按到达顺序分配，运行时间相同时先到达的作业即等待时间最长的作业
+#define SJF_ARITY 4
+
+struct sjfheap {
+    struct jobinfo **jobs;              // 堆数组
+    int count;                          // 堆中的作业数
+    int cap;                            // 数组容量
+};
+
+// 作业索引：以作业ID或进程号为键的开放定址散列表，线性探测，
+// 删除时把后续元素前移而不留墓碑，查找、插入和删除的期望时间都是常数
+struct jobslot {
+    int key;                            // 键
+    struct jobinfo *job;                // 作业，NULL表示空槽
+};
+
+struct jobindex {
+    struct jobslot *slots;              // 槽数组，长度为2的幂
+    int bits;                           // 槽数组长度的对数
+    int count;                          // 索引中的作业数
+};
+
+// 老化时间轮：按下次提升优先级的时刻(promote_at)把作业挂到对应的槽上，
+// 时钟推进时只检查已到期的槽。一圈覆盖的时间必须大于最长的定时间隔
+#define WHEEL_MS 8          // 每个槽覆盖的时间（单位：毫秒）
+#define WHEEL_SLOTS 512     // 槽数，一圈覆盖4096毫秒
+
+struct agewheel {
+    struct jobqueue slot[WHEEL_SLOTS];  // 各槽
+    long cursor;                        // 下一个要检查的槽序号
+    int count;                          // 时间轮中的作业数
+};
+
+// HRRN就绪队列：按预计运行时间对数分级，每级内按到达顺序排列。
+// 小于HRRN_SUB的运行时间每个值一级，更大的每个2的幂区间均分为HRRN_SUB级，同级的运行时间
+// 相差不超过1/HRRN_SUB。只比较各非空级的队首，选中作业的等待时间与运行时间之比
+// 不低于最大值的HRRN_SUB/(HRRN_SUB+1)；选择最多检查HRRN_NCLASS个队首，与排队的作业数无关
+#define HRRN_SUBBITS 4
+#define HRRN_SUB (1 << HRRN_SUBBITS)    // 每个2的幂区间的级数
+#define HRRN_MAXBITS 16                 // 预计运行时间不超过2^16-1
+#define HRRN_NCLASS (HRRN_SUB + (HRRN_MAXBITS - HRRN_SUBBITS) * HRRN_SUB)
+#define HRRN_WORDS ((HRRN_NCLASS + 63) / 64)
+
+struct hrrnqueue {
+    struct jobqueue level[HRRN_NCLASS]; // 各级的作业
+    uint64_t mask[HRRN_WORDS];          // 非空级别位图
+    int count;                          // 队列中的作业数
+};
+
+// 多级反馈队列：每级一个先进先出队列，位图记录非空的级别，级别越小优先级越高。
+// 周期性提升把各级队列整体接到第0级队尾，作业的级别字段按提升轮次延迟修正
+#define MLFQ_LEVELS 3
+
+struct mlfqueue {
+    struct jobqueue level[MLFQ_LEVELS]; // 各级队列
+    int quantum[MLFQ_LEVELS];           // 各级时间片（单位：毫秒）
+    unsigned int mask;                  // 非空级别位图
+    unsigned int epoch;                 // 提升轮次
+    int count;                          // 队列中的作业数
+};
+
+void queue_push(struct jobqueue *q, struct waitqueue *p);
+void queue_pushfront(struct jobqueue *q, struct waitqueue *p);
+void queue_insertafter(struct jobqueue *q, struct waitqueue *pos, struct waitqueue *p);
+void queue_remove(struct jobqueue *q, struct waitqueue *p);
+void queue_splice(struct jobqueue *q, struct jobqueue *from);
+struct waitqueue *queue_pop(struct jobqueue *q);
+
+void index_insert(struct jobindex *ix, int key, struct jobinfo *job);
+void index_remove(struct jobindex *ix, int key);
+struct jobinfo *index_find(struct jobindex *ix, int key);
+
+void wheel_add(struct agewheel *w, struct jobinfo *job);
+void wheel_remove(struct agewheel *w, struct jobinfo *job);
+struct jobinfo *wheel_expire(struct agewheel *w, long now);
+
+void hpf_insert(struct hpfqueue *q, struct jobinfo *job, int front);
+void hpf_remove(struct hpfqueue *q, struct jobinfo *job);
+struct jobinfo *hpf_pop(struct hpfqueue *q);
+
+void hrrn_insert(struct hrrnqueue *q, struct jobinfo *job);
+void hrrn_remove(struct hrrnqueue *q, struct jobinfo *job);
+struct jobinfo *hrrn_pop(struct hrrnqueue *q, long now);
+
+int mlfq_level(struct mlfqueue *q, struct jobinfo *job);
+void mlfq_insert(struct mlfqueue *q, struct jobinfo *job, int front);
+void mlfq_remove(struct mlfqueue *q, struct jobinfo *job);
+struct jobinfo *mlfq_pop(struct mlfqueue *q);
+void mlfq_boost(struct mlfqueue *q);
+
+void sjf_insert(struct sjfheap *h, struct jobinfo *job);
+void sjf_remove(struct sjfheap *h, struct jobinfo *job);
+struct jobinfo *sjf_peek(struct sjfheap *h);
+struct jobinfo *sjf_pop(struct sjfheap *h);
+struct jobinfo *sjf_pushpop(struct sjfheap *h, struct jobinfo *job);
+
+#endif
@@ -1,23 +1,49 @@
 /**
  * @file scheduler.c
  * @brief 进程调度器实现
- * @details 实现了一个支持多种调度算法的进程调度器，包括HPF、FCFS和SJF算法
+ * @details 实现了一个支持多种调度算法的进程调度器，包括HPF、FCFS和SJF算法。
+ *          作业分布在若干执行槽上同时运行，每个槽绑定一个CPU并有自己的就绪队列
  */
 
+#define _GNU_SOURCE     // sched_setaffinity、CPU_SET
+
 #include <signal.h>     // 信号处理
 #include <stdio.h>      // 标准输入输出
 #include <unistd.h>     // 系统调用接口
+#include <errno.h>      // 错误码
+#include <stdint.h>     // 定长整数类型
 #include <sys/types.h>  // 基本系统数据类型
 #include <sys/stat.h>   // 文件状态
 #include <sys/time.h>   // 时间相关
 #include <sys/wait.h>   // 进程等待
+#include <sys/resource.h>   // 回收子进程时的资源使用
+#include <sys/epoll.h>  // 事件循环
+#include <sys/timerfd.h>    // 定时器文件描述符
+#include <sys/signalfd.h>   // 信号文件描述符
+#include <sys/syscall.h>    // pidfd_open、pidfd_send_signal
+#include <sys/socket.h>     // 控制套接字
+#include <sys/un.h>         // sockaddr_un
 #include <string.h>     // 字符串处理
+#include <sched.h>      // CPU亲和性
 
 #include <fcntl.h>      // 文件控制
 #include <time.h>       // 时间函数
 #include <ucontext.h>   // 用户上下文定义
 #include <stdlib.h>     // 动态内存分配、exit、atoi
+#include <limits.h>     // PATH_MAX
 #include "job.h"        // 作业相关定义
+#include "proto.h"      // 命令协议
+#include "queue.h"      // 就绪队列
+#include "policy.h"     // 调度核心
+#include "pool.h"       // 作业记录内存池
+#include "launcher.h"   // 作业启动进程
+#include "jobtab.h"     // 共享内存作业表
+#include "hist.h"       // 延迟直方图
+#include "trace.h"      // 调度事件跟踪环
+
+#ifndef P_PIDFD
+#define P_PIDFD 3       // waitid按pidfd等待（Linux 5.4）
+#endif
 
 // 错误处理函数
 void error_sys(const char *msg) {
@@ -27,50 +53,161 @@ void error_sys(const char *msg) {
 
 // 全局变量定义
 int jobid = 0;          // 作业ID计数器
-int siginfo = 1;        // 信号处理标志
+int siginfo = 1;        // 主循环运行标志，收到SIGINT/SIGTERM后清零
 int fifo;               // FIFO文件描述符
+int fifo_keep;          // FIFO保活写端，避免最后一个写者关闭后读端持续报告挂断
 int globalfd;           // 全局文件描述符
-#define MAX_QUEUES 3    // 多级反馈队列的最大队列数
-#define TIME_QUANTUM 2  // 时间片大小（单位：秒）
-int current_queue = 0;  // 当前队列索引
+int launchfd = -1;      // 与作业启动进程通信的套接字
+char *cgroot = NULL;    // 作业cgroup的父目录，NULL表示只按进程组控制作业
+int *cgstale = NULL;    // 还有进程未退出、尚未删除的作业cgroup（作业ID）
+int ncgstale = 0;       // 未删除的作业cgroup个数
+int cgstale_cap = 0;    // cgstale的容量
+int epfd;               // epoll实例
+int timerfd;            // 调度时钟
+int sigfd;              // 信号文件描述符（SIGCHLD、SIGINT、SIGTERM）
+sigset_t oldmask;       // 启动前的信号屏蔽字，子进程执行作业前恢复
+#define QUANTUM_MIN 5       // 时间片下限（单位：毫秒）
+#define QUANTUM_MAX 10000   // 时间片上限（单位：毫秒）
+int quantum;            // 调度时钟周期（单位：毫秒）
+int timer_armed = 0;    // 调度时钟是否在运行
+uint64_t last_tick;     // 上次记账的单调时钟时刻（单位：纳秒）
+#define INGEST_BUFLEN 65536             // 命令接收缓冲区初始大小，遇到大帧时按需扩大
+#define SLOWDOWN_MIN_NS 10000000        // 减速比的服务时间下限（10ms），避免几乎不占CPU的作业得到极大的比值
+#define INGEST_MAXREAD 64               // 每次事件最多读取次数，避免命令洪泛饿死调度时钟
+char *ingest_buf = NULL;                // 命令接收缓冲区
+size_t ingest_cap = 0;                  // 缓冲区容量
+size_t ingest_len = 0;                  // 缓冲区中尚未解析的字节数
+
+// epoll事件的标签：高8位为事件源类型，其余为事件源的标识。
+// 同一批事件中文件描述符可能已被关闭并分配给新的连接或pidfd，按标识重新查找，过期的事件直接丢弃
+#define EV_SIGNAL   1       // 信号文件描述符
+#define EV_FIFO     2       // 命令FIFO
+#define EV_TIMER    3       // 调度时钟
+#define EV_ACCEPT   4       // 控制套接字
+#define EV_CONN     5       // 连接：文件描述符和连接序号
+#define EV_PIDFD    6       // 作业进程的pidfd：作业ID，作业ID不会复用
+#define EV_TAG(type, hi, lo) ((uint64_t)(type) << 56 | (uint64_t)(uint32_t)(hi) << 32 | (uint32_t)(lo))
+#define EV_TYPE(tag) ((int)((tag) >> 56))
+#define EV_HI(tag) ((int)(((tag) >> 32) & 0xffffff))
+#define EV_LO(tag) ((uint32_t)(tag))
+
+// 控制套接字上的一个连接
+struct conn {
+	int fd;                 // 连接套接字
+	uint32_t serial;        // 连接序号，区分先后复用同一文件描述符的连接
+	char *out;              // 未能立即发出的应答，每条前有uint32_t长度
+	size_t outlen;          // 待发应答的字节数
+	size_t outcap;          // 待发缓冲区容量
+	size_t outoff;          // 已发出的字节数
+	int dead;               // 对端已关闭或出错，处理完本次事件后关闭
+};
+int ctlfd = -1;                         // 控制套接字，-1表示未能创建
+struct conn **conns = NULL;             // 按文件描述符索引的连接
+int nconns = 0;                         // conns数组长度
+uint32_t conn_serial = 0;               // 上一个连接的序号
+char *ctl_buf = NULL;                   // 控制消息接收缓冲区，PROTO_MAXMSG字节
 
 // 作业队列相关指针
-struct waitqueue *head = NULL;      // 等待队列头指针
-struct waitqueue *next = NULL;      // 下一个要运行的作业
-struct waitqueue *current = NULL;   // 当前运行的作业
+struct jobqueue jobs;               // 全部作业，按到达顺序排列
+struct jobindex jidindex;           // 作业ID到作业的索引
+struct jobindex pidindex;           // 进程号到作业的索引
+struct jobtab *jobtab = NULL;       // 发布给stat命令的作业表，NULL表示未能创建
+struct tracering *tracer = NULL;    // 调度事件跟踪环，NULL表示未启用跟踪
+
+// 一组延迟直方图，每个指标一个
+struct latset {
+	int owner;                          // 所有者ID，LAT_ALLOWNERS表示全部作业
+	struct hist h[LAT_NMETRIC];         // 各指标的直方图
+};
+const char *policy_name;                // 选用的调度算法名称
+struct latset lat_all = { .owner = LAT_ALLOWNERS };  // 全部已结束作业的延迟
+struct latset *lat_owner[LAT_MAXOWNERS];    // 各所有者的延迟，首次有作业结束时分配
+int nlat_owner = 0;                     // 单独统计的所有者个数
+
+int64_t jobcputime(const struct jobinfo *job);
+void jobkill(struct jobinfo *job);
+void cgremove(struct jobinfo *job);
+void do_latency(void);
+long jobwait(const struct jobinfo *job);
+void jobtrace(int type, const struct jobinfo *job, int arg);
 
 /**
- * @brief 调度器核心函数
- * @details 处理作业命令、更新作业状态、选择下一个要运行的作业
+ * @brief 读取单调时钟
+ * @return 当前时刻（单位：纳秒），不受系统时间调整影响
  */
-void schedule()
+uint64_t now_ns()
 {
-	struct jobinfo *newjob = NULL;
-	struct jobcmd cmd;
-	int count = 0;
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/**
+ * @brief 启动调度时钟
+ * @details 以绝对时刻设置周期定时器，到期时刻按固定步长推进，处理延迟不会累积成漂移
+ */
+void timer_arm()
+{
+	struct itimerspec its;
+	uint64_t start;
 
-	// 清空命令结构体并读取新命令
-	bzero(&cmd, DATALEN);
-	if ((count = read(fifo, &cmd, DATALEN)) < 0)
-		error_sys("read fifo failed");
+	if (timer_armed)
+		return;
+
+	last_tick = now_ns();
+	start = last_tick + (uint64_t)quantum * 1000000ULL;
+	its.it_value.tv_sec = start / 1000000000ULL;
+	its.it_value.tv_nsec = start % 1000000000ULL;
+	its.it_interval.tv_sec = quantum / 1000;
+	its.it_interval.tv_nsec = (quantum % 1000) * 1000000L;
+	if (timerfd_settime(timerfd, TFD_TIMER_ABSTIME, &its, NULL) < 0)
+		error_sys("timerfd_settime failed");
+	timer_armed = 1;
+}
+
+/**
+ * @brief 停止调度时钟
+ * @details 没有作业时不再产生时钟事件，调度器完全空闲
+ */
+void timer_disarm()
+{
+	struct itimerspec its;
+
+	if (!timer_armed)
+		return;
+
+	memset(&its, 0, sizeof(its));
+	if (timerfd_settime(timerfd, 0, &its, NULL) < 0)
+		error_sys("timerfd_settime failed");
+	timer_armed = 0;
+}
+
+/**
+ * @brief 处理一条作业命令
+ * @param cmd 已解码的命令
+ * @return 入队：新作业ID；出队：0；其他命令：0；命令无法执行时返回-1
+ */
+int do_cmd(struct jobcmd *cmd)
+{
+	int ret = 0;
 
 #ifdef DEBUG
 	// 调试信息输出
-	if (count) {
-		printf("cmd cmdtype\t%d\n"
-			"cmd defpri\t%d\n"
-			"cmd data\t%s\n",
-			cmd.type, cmd.defpri, cmd.data);
-	}
+	printf("cmd cmdtype\t%d\n"
+		"cmd defpri\t%d\n"
+		"cmd argnum\t%d\n",
+		cmd->type, cmd->defpri, cmd->argnum);
 #endif
 
 	// 根据命令类型执行相应操作
-	switch (cmd.type) {
+	switch (cmd->type) {
 	case ENQ:    // 作业入队
-		do_enq(newjob,cmd);
+		ret = do_enq(cmd);
+		timer_arm();
 		break;
 	case DEQ:    // 作业出队
-		do_deq(cmd);
+		ret = do_deq(cmd);
 		break;
 	case STAT:   // 状态查询
 		do_stat();
@@ -78,15 +215,504 @@ void schedule()
 	default:
 		break;
 	}
+	return ret;
+}
 
-	// 更新所有作业状态
-	updateall();
+/**
+ * @brief 处理一个完整的帧
+ * @param head 帧头
+ * @param body 消息体
+ * @param rep 输出的应答，NULL表示不需要应答（来自FIFO）
+ * @return 执行的命令条数，-1表示消息体格式错误
+ */
+int do_frame(const struct msghead *head, const char *body, struct replybody *rep)
+{
+	struct jobcmd cmd;
+	struct deqbody deq;
+	struct replybody dummy;
+	const char *end = body + head->len, *p;
+	uint32_t count, i;
+	long n;
+	int ret;
+
+	if (rep == NULL)
+		rep = &dummy;
+	memset(rep, 0, sizeof(*rep));
+	memset(&cmd, 0, sizeof(cmd));
+	switch (head->type) {
+	case MSG_ENQ:    // 单个作业入队
+		if (proto_parseenq(body, head->len, &cmd) != (long)head->len)
+			return -1;
+		if ((ret = do_cmd(&cmd)) < 0) {
+			rep->status = EINVAL;
+		} else {
+			rep->jid = ret;
+			rep->count = 1;
+		}
+		return 1;
+
+	case MSG_ENQBATCH:  // 批量入队，先校验整帧，有坏记录或多余字节时整帧丢弃
+		if (head->len < sizeof(count))
+			return -1;
+		memcpy(&count, body, sizeof(count));
+		body += sizeof(count);
+		// 记录数来自消息，先按最短记录的长度限制，再逐条校验到恰好结束
+		if (count > (end - body) / PROTO_ENQMIN)
+			return -1;
+		for (p = body, i = 0; i < count; i++, p += n)
+			if ((n = proto_parseenq(p, end - p, &cmd)) < 0)
+				return -1;
+		if (p != end)
+			return -1;
+
+		for (i = 0; i < count; i++) {
+			n = proto_parseenq(body, end - body, &cmd);
+			// 逐条入队期间不会插入其他作业，新作业的ID是连续的
+			if ((ret = do_cmd(&cmd)) < 0) {
+				rep->status = EINVAL;
+			} else {
+				if (rep->count++ == 0)
+					rep->jid = ret;
+			}
+			body += n;
+		}
+		return count;
+
+	case MSG_DEQ:    // 作业出队
+		if (head->len != sizeof(deq))
+			return -1;
+		memcpy(&deq, body, sizeof(deq));
+		cmd.type = DEQ;
+		cmd.owner = deq.owner;
+		cmd.jid = deq.jid;
+		rep->jid = deq.jid;
+		if (do_cmd(&cmd) < 0)
+			rep->status = ESRCH;
+		return 1;
+
+	case MSG_STAT:   // 状态查询
+		cmd.type = STAT;
+		do_cmd(&cmd);
+		return 1;
+
+	case MSG_LATENCY:   // 延迟统计查询，经FIFO时打印在调度器的输出中
+		do_latency();
+		return 1;
 
-	// 选择下一个要运行的作业
-	next = (*jobselect)();
+	default:
+		return -1;
+	}
+}
+
+/**
+ * @brief 命令接收阶段
+ * @details FIFO可读时由事件循环调用。按大块读取FIFO直到读空，解析缓冲区中
+ *          所有完整的帧并逐条执行，不完整的尾部留到下次；整批命令处理完后
+ *          若处理器空闲则立即做一次作业选择，不必等待下一个时钟。
+ *          帧头非法时无法重新同步，丢弃缓冲区中已收到的全部数据
+ */
+void do_ingest()
+{
+	struct msghead head;
+	size_t off, need;
+	ssize_t count;
+	int ncmd = 0, nread, ret, i;
+
+	for (nread = 0; nread < INGEST_MAXREAD; nread++) {
+		if (ingest_len == ingest_cap) {
+			printf("command frame too large, discard %zu bytes\n", ingest_len);
+			ingest_len = 0;
+		}
+		count = read(fifo, ingest_buf + ingest_len, ingest_cap - ingest_len);
+		if (count < 0) {
+			if (errno == EINTR)
+				continue;
+			if (errno == EAGAIN)
+				break;
+			error_sys("read fifo failed");
+		}
+		if (count == 0)
+			break;
+		ingest_len += count;
+
+		// 解析所有完整的帧
+		for (off = 0; ; off += sizeof(head) + head.len) {
+			ret = proto_parsehead(ingest_buf + off, ingest_len - off, &head);
+			if (ret < 0) {
+				printf("bad command frame, discard %zu bytes\n", ingest_len - off);
+				off = ingest_len;
+				break;
+			}
+			if (ret == 0 || ingest_len - off < sizeof(head) + head.len)
+				break;
+			if ((ret = do_frame(&head, ingest_buf + off + sizeof(head), NULL)) < 0)
+				printf("bad command type %d, length %u\n", head.type, head.len);
+			else
+				ncmd += ret;
+		}
+		memmove(ingest_buf, ingest_buf + off, ingest_len - off);
+		ingest_len -= off;
+
+		// 未完成的帧比缓冲区大时扩大缓冲区
+		if (ret > 0 && (need = sizeof(head) + head.len) > ingest_cap) {
+			if ((ingest_buf = realloc(ingest_buf, need)) == NULL)
+				error_sys("realloc failed");
+			ingest_cap = need;
+		}
+	}
 
-	// 执行作业切换
-	jobswitch();
+	// 整批处理完后空闲的执行槽各做一次作业选择
+	for (i = 0; ncmd > 0 && i < nslot; i++)
+		if (slots[i].current == NULL)
+			dispatch(&slots[i]);
+}
+
+/**
+ * @brief 创建控制套接字
+ * @return 0表示成功，-1表示失败，此时只能通过FIFO提交命令
+ */
+int ctl_listen()
+{
+	struct sockaddr_un addr;
+
+	if ((ctlfd = socket(AF_UNIX, SOCK_SEQPACKET|SOCK_NONBLOCK|SOCK_CLOEXEC, 0)) < 0) {
+		perror("socket");
+		return -1;
+	}
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strncpy(addr.sun_path, PROTO_SOCK, sizeof(addr.sun_path) - 1);
+	unlink(PROTO_SOCK);
+	if (bind(ctlfd, (struct sockaddr *)&addr, sizeof(addr)) < 0 ||
+	    chmod(PROTO_SOCK, 0666) < 0 || listen(ctlfd, SOMAXCONN) < 0) {
+		perror("control socket");
+		close(ctlfd);
+		ctlfd = -1;
+		return -1;
+	}
+	if ((ctl_buf = malloc(PROTO_MAXMSG)) == NULL)
+		error_sys("malloc failed");
+	return 0;
+}
+
+/**
+ * @brief 修改连接关注的事件
+ * @param c 连接
+ * @details 有应答未发出时只等待可写，不再读取新请求，直到客户端取走应答
+ */
+void conn_watch(struct conn *c)
+{
+	struct epoll_event ev;
+
+	memset(&ev, 0, sizeof(ev));
+	ev.events = c->outlen > c->outoff ? EPOLLOUT : EPOLLIN;
+	ev.data.u64 = EV_TAG(EV_CONN, c->fd, c->serial);
+	epoll_ctl(epfd, EPOLL_CTL_MOD, c->fd, &ev);
+}
+
+/**
+ * @brief 发出缓存的应答
+ * @param c 连接
+ */
+void conn_flush(struct conn *c)
+{
+	uint32_t len;
+	ssize_t n;
+
+	while (c->outoff < c->outlen) {
+		memcpy(&len, c->out + c->outoff, sizeof(len));
+		n = send(c->fd, c->out + c->outoff + sizeof(len), len, MSG_DONTWAIT|MSG_NOSIGNAL);
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+			if (errno != EAGAIN)
+				c->dead = 1;
+			return;
+		}
+		c->outoff += sizeof(len) + len;
+	}
+	c->outoff = c->outlen = 0;
+}
+
+/**
+ * @brief 向连接发送一个应答帧
+ * @param c 连接
+ * @param msg 应答帧
+ * @param len 帧长度
+ * @details 能立即发出时直接发送，否则按顺序缓存，等连接可写时再发
+ */
+void conn_send(struct conn *c, const char *msg, size_t len)
+{
+	uint32_t n = len;
+
+	if (c->dead)
+		return;
+	if (c->outlen == c->outoff) {
+		while (send(c->fd, msg, len, MSG_DONTWAIT|MSG_NOSIGNAL) < 0) {
+			if (errno == EINTR)
+				continue;
+			if (errno != EAGAIN) {
+				c->dead = 1;
+				return;
+			}
+			goto queue;
+		}
+		return;
+	}
+
+queue:
+	if (c->outlen + sizeof(n) + len > c->outcap) {
+		c->outcap = (c->outlen + sizeof(n) + len) * 2;
+		if ((c->out = realloc(c->out, c->outcap)) == NULL)
+			error_sys("realloc failed");
+	}
+	memcpy(c->out + c->outlen, &n, sizeof(n));
+	memcpy(c->out + c->outlen + sizeof(n), msg, len);
+	c->outlen += sizeof(n) + len;
+}
+
+/**
+ * @brief 发送简单应答
+ * @param c 连接
+ * @param rep 应答
+ */
+void conn_reply(struct conn *c, const struct replybody *rep)
+{
+	char msg[sizeof(struct msghead) + sizeof(*rep)];
+
+	memcpy(msg + proto_head(msg, MSG_REPLY, sizeof(*rep)), rep, sizeof(*rep));
+	conn_send(c, msg, sizeof(msg));
+}
+
+/**
+ * @brief 把所有作业的状态作为应答发送
+ * @param c 连接
+ * @details 作业较多时分成多个应答帧，除最后一帧外都带有more标志
+ */
+void conn_stat(struct conn *c)
+{
+	char msg[PROTO_MAXMSG];
+	struct replybody rep;
+	struct statrow row;
+	struct waitqueue *p;
+	char *q = msg + sizeof(struct msghead) + sizeof(rep);
+	int64_t cpu;
+
+	memset(&rep, 0, sizeof(rep));
+	memset(&row, 0, sizeof(row));
+	for (p = jobs.head; ; p = p->next) {
+		// 本帧已满或没有更多作业时发出本帧
+		if (p == NULL || rep.count == STATROWS_PER_MSG) {
+			rep.more = p != NULL;
+			proto_head(msg, MSG_REPLY, q - msg - sizeof(struct msghead));
+			memcpy(msg + sizeof(struct msghead), &rep, sizeof(rep));
+			conn_send(c, msg, q - msg);
+			if (p == NULL)
+				break;
+			rep.count = 0;
+			q = msg + sizeof(struct msghead) + sizeof(rep);
+		}
+
+		row.jid = p->job->jid;
+		row.pid = p->job->pid;
+		row.owner = p->job->ownerid;
+		row.run_time = p->job->run_time;
+		if (p == slots[p->job->slot].current && (cpu = jobcputime(p->job)) > (int64_t)p->job->cpu_ns)
+			row.run_time = cpu / 1000000;
+		row.state = p->job->state;
+		row.defpri = p->job->defpri;
+		row.curpri = p->job->curpri;
+		row.wait_time = jobwait(p->job);
+		row.create_time = p->job->create_time;
+		memcpy(q, &row, sizeof(row));
+		q += sizeof(row);
+		rep.count++;
+	}
+}
+
+/**
+ * @brief 汇总延迟统计
+ * @param rows 输出的统计行，至少(LAT_MAXOWNERS + 1) * LAT_NMETRIC行
+ * @return 行数：先是全部作业，再按首次出现的顺序是各所有者
+ * @details 百分位由直方图的桶直接得出，与已结束的作业数无关
+ */
+int lat_rows(struct latrow *rows)
+{
+	const struct latset *set;
+	int i, m, n = 0;
+
+	for (i = -1; i < nlat_owner; i++) {
+		set = i < 0 ? &lat_all : lat_owner[i];
+		for (m = 0; m < LAT_NMETRIC; m++, n++) {
+			rows[n].owner = set->owner;
+			rows[n].metric = m;
+			rows[n].count = set->h[m].count;
+			rows[n].p50 = hist_quantile(&set->h[m], 0.5);
+			rows[n].p99 = hist_quantile(&set->h[m], 0.99);
+			rows[n].p999 = hist_quantile(&set->h[m], 0.999);
+			rows[n].max = set->h[m].max;
+		}
+	}
+	return n;
+}
+
+/**
+ * @brief 把延迟统计作为应答发送
+ * @param c 连接
+ */
+void conn_latency(struct conn *c)
+{
+	char msg[sizeof(struct msghead) + sizeof(struct replybody) + LAT_POLICYLEN +
+		(LAT_MAXOWNERS + 1) * LAT_NMETRIC * sizeof(struct latrow)];
+	char *q = msg + sizeof(struct msghead);
+	struct replybody rep;
+
+	memset(&rep, 0, sizeof(rep));
+	rep.count = lat_rows((struct latrow *)(q + sizeof(rep) + LAT_POLICYLEN));
+	memcpy(q, &rep, sizeof(rep));
+	memset(q + sizeof(rep), 0, LAT_POLICYLEN);
+	strncpy(q + sizeof(rep), policy_name, LAT_POLICYLEN - 1);
+	q += sizeof(rep) + LAT_POLICYLEN + rep.count * sizeof(struct latrow);
+	proto_head(msg, MSG_REPLY, q - msg - sizeof(struct msghead));
+	conn_send(c, msg, q - msg);
+}
+
+/**
+ * @brief 关闭连接
+ * @param c 连接
+ */
+void conn_close(struct conn *c)
+{
+	conns[c->fd] = NULL;
+	close(c->fd);   // 关闭后自动从epoll中删除
+	free(c->out);
+	free(c);
+}
+
+/**
+ * @brief 接受控制套接字上的新连接
+ */
+void do_accept()
+{
+	struct epoll_event ev;
+	struct conn *c;
+	int fd;
+
+	while ((fd = accept4(ctlfd, NULL, NULL, SOCK_NONBLOCK|SOCK_CLOEXEC)) >= 0) {
+		if (fd >= nconns) {
+			if ((conns = realloc(conns, sizeof(*conns) * (fd + 1) * 2)) == NULL)
+				error_sys("realloc failed");
+			memset(conns + nconns, 0, sizeof(*conns) * ((fd + 1) * 2 - nconns));
+			nconns = (fd + 1) * 2;
+		}
+		if ((c = calloc(1, sizeof(*c))) == NULL)
+			error_sys("calloc failed");
+		c->fd = fd;
+		c->serial = ++conn_serial;
+		conns[fd] = c;
+
+		memset(&ev, 0, sizeof(ev));
+		ev.events = EPOLLIN;
+		ev.data.u64 = EV_TAG(EV_CONN, fd, c->serial);
+		if (epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &ev) < 0) {
+			perror("epoll_ctl conn");
+			conn_close(c);
+		}
+	}
+}
+
+/**
+ * @brief 连接上的事件处理函数
+ * @param c 连接
+ * @param events epoll报告的事件
+ * @details 每条消息是一个完整的帧，按顺序处理并各回复一个应答。一次最多处理
+ *          INGEST_MAXREAD条，应答发不出去时停止读取，让客户端先取走应答
+ */
+void do_conn(struct conn *c, uint32_t events)
+{
+	struct msghead head;
+	struct replybody rep;
+	ssize_t n;
+	int ncmd = 0, nread, ret, i;
+
+	if (c->outlen > c->outoff)
+		conn_flush(c);
+
+	for (nread = 0; nread < INGEST_MAXREAD && !c->dead && c->outlen == c->outoff; nread++) {
+		n = recv(c->fd, ctl_buf, PROTO_MAXMSG, MSG_DONTWAIT|MSG_TRUNC);
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+			if (errno != EAGAIN)
+				c->dead = 1;
+			break;
+		}
+		if (n == 0) {   // 客户端已关闭连接
+			c->dead = 1;
+			break;
+		}
+
+		memset(&rep, 0, sizeof(rep));
+		if (n > PROTO_MAXMSG) {
+			rep.status = EMSGSIZE;
+		} else if (proto_parsehead(ctl_buf, n, &head) != 1 || head.len != n - sizeof(head)) {
+			rep.status = EBADMSG;
+		} else if (head.type == MSG_STAT) {
+			conn_stat(c);
+			continue;
+		} else if (head.type == MSG_LATENCY) {
+			conn_latency(c);
+			continue;
+		} else if ((ret = do_frame(&head, ctl_buf + sizeof(head), &rep)) < 0) {
+			rep.status = EBADMSG;
+		} else {
+			ncmd += ret;
+		}
+		conn_reply(c, &rep);
+	}
+
+	// 与FIFO命令一样，整批处理完后空闲的执行槽各做一次作业选择
+	for (i = 0; ncmd > 0 && i < nslot; i++)
+		if (slots[i].current == NULL)
+			dispatch(&slots[i]);
+
+	if (c->dead) {
+		conn_close(c);
+		return;
+	}
+	// 读满一批后若仍有数据，epoll会再次报告；待发应答的状态变化时调整关注的事件
+	if ((events & EPOLLOUT) != (c->outlen > c->outoff ? EPOLLOUT : 0))
+		conn_watch(c);
+}
+
+/**
+ * @brief 把作业进程绑定到CPU
+ * @param pid 进程号，0表示调用者自己
+ * @param cpu CPU编号，-1表示不绑定
+ */
+void jobpin(int pid, int cpu)
+{
+	cpu_set_t set;
+
+	if (cpu < 0)
+		return;
+	CPU_ZERO(&set);
+	CPU_SET(cpu, &set);
+	if (sched_setaffinity(pid, sizeof(set), &set) < 0)
+		perror("sched_setaffinity");
+}
+
+/**
+ * @brief 作业被窃取到另一个执行槽
+ * @param job 作业，slot已指向新的执行槽
+ * @details 已创建进程的作业改绑到新执行槽的CPU，尚未创建的作业在创建时绑定
+ */
+void jobmigrate(struct jobinfo *job)
+{
+	if (job->pid > 0)
+		jobpin(job->pid, slots[job->slot].cpu);
+	jobpublish(job);
+	jobtrace(TRACE_MIGRATE, job, 0);
 }
 
 /**
@@ -99,275 +725,537 @@ int allocjid()
 }
 
 /**
- * @brief 更新所有作业的状态
- * @details 更新运行中作业的运行时间和等待中作业的等待时间
+ * @brief 把作业的当前状态发布到共享内存作业表
+ * @param job 作业
  */
-void updateall()
+void jobpublish(const struct jobinfo *job)
 {
-	struct waitqueue *p;
+	if (jobtab != NULL)
+		jobtab_put(jobtab, job->tabrow, job);
+}
 
-	// 更新运行中作业的运行时间
-	if (current)
-		current->job->run_time += 1;    // 增加1表示100ms
+/**
+ * @brief 记录作业的调度事件
+ * @param type 事件类型（见trace.h）
+ * @param job 作业
+ * @param arg 附加参数
+ */
+void jobtrace(int type, const struct jobinfo *job, int arg)
+{
+	if (tracer != NULL)
+		trace_emit(tracer, type, job->slot, job->jid, job->pid, arg);
+}
 
-	// 更新等待中作业的等待时间和优先级
-	for (p = head; p != NULL; p = p->next) {
-		p->job->wait_time += 1;
+/**
+ * @brief 释放作业
+ * @param p 作业节点，调用前必须已离开就绪队列
+ * @details 从作业链表和索引中删除作业并释放其资源
+ */
+void jobfree(struct waitqueue *p)
+{
+	queue_remove(&jobs, p);
+	if (p->job->curpri < 3)
+		wheel_remove(&agewheel, p->job);
+	index_remove(&jidindex, p->job->jid);
+	if (jobtab != NULL)
+		jobtab_free(jobtab, p->job->tabrow);
+	if (p->job->pid > 0)
+		index_remove(&pidindex, p->job->pid);
+	// 终止作业进程树中剩余的进程：出队的作业整棵树，已结束的作业遗留的子孙进程。
+	// 必须在关闭pidfd之前，进程组不存在时还要通过pidfd向作业进程发信号
+	if (p->job->pid > 0)
+		jobkill(p->job);
+	if (p->job->pidfd >= 0) {
+		close(p->job->pidfd);   // 关闭后自动从epoll中删除
+	}
+	if (p->job->cgroup)
+		cgremove(p->job);
+	if (p->job->cpufd >= 0)
+		close(p->job->cpufd);
+	blob_release(p->job->cmdarg);
+	job_release(p->job);
+}
 
-		// 如果等待时间超过1个时间片且当前优先级小于3，则提升优先级
-		if (p->job->wait_time > 1 && p->job->curpri < 3)
-			p->job->curpri++;
+/**
+ * @brief 读取作业已使用的CPU时间
+ * @param job 作业
+ * @return 纳秒，-1表示无法获得
+ * @details 有cgroup时读cpu.stat中的usage_usec，包括整个进程树；
+ *          否则读作业进程的CPU时钟，不含它创建的子进程
+ */
+int64_t jobcputime(const struct jobinfo *job)
+{
+	struct timespec ts;
+	char buf[256], *s;
+	ssize_t n;
+
+	if (job->cpufd >= 0 && (n = pread(job->cpufd, buf, sizeof(buf) - 1, 0)) > 0) {
+		buf[n] = '\0';
+		if ((s = strstr(buf, "usage_usec ")) != NULL)
+			return strtoll(s + 11, NULL, 10) * 1000;
 	}
+	if (job->pid > 0 && clock_gettime(job->cpuclock, &ts) == 0)
+		return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+	return -1;
 }
 
 /**
- * @brief 高优先级优先(HPF)调度算法
- * @return 选中的作业
- * @details 选择当前优先级最高的作业，如果优先级相同则选择等待时间最长的作业
+ * @brief 按实际使用的CPU时间记账
+ * @param job 运行中的作业
+ * @param elapsed 距上次记账经过的墙上时间（单位：毫秒），无法读取CPU时间时按它记账
+ * @return 本次记入的CPU时间（单位：毫秒）
  */
-struct waitqueue* jobselect_HPF()
+int jobcharge(struct jobinfo *job, int elapsed)
 {
-	struct waitqueue *p, *selected = NULL;
-	int highest_pri = -1;  // 最高优先级初始化为-1
+	int64_t now = jobcputime(job);
+	int before = job->run_time;
+
+	if (now < 0)
+		job->cpu_ns += (uint64_t)elapsed * 1000000;
+	else if ((uint64_t)now > job->cpu_ns)
+		job->cpu_ns = now;
+	job->run_time = job->cpu_ns / 1000000;
+	return job->run_time - before;
+}
 
-	// 遍历等待队列，找到优先级最高的作业
-	for (p = head; p != NULL; p = p->next) {
-		// 如果找到更高优先级的作业，或者优先级相同但等待时间更长
-		if (p->job->curpri > highest_pri || 
-			(p->job->curpri == highest_pri && 
-			 p->job->wait_time > selected->job->wait_time)) {
-			highest_pri = p->job->curpri;
-			selected = p;
+/**
+ * @brief 更新所有作业的状态
+ * @param elapsed 距上次更新经过的时间（单位：毫秒）
+ * @details 推进调度时钟并按实际使用的CPU时间更新运行中作业的运行时间和时间片。
+ *          与其他进程争用CPU的作业只消耗实际得到的CPU时间；但大部分时间阻塞的作业仍占着执行槽，
+ *          时间片按墙上时间消耗，否则它会一直停在高级别上挡住其他作业。最后老化等待的作业
+ */
+void updateall(int elapsed)
+{
+	struct jobinfo *job;
+	struct runslot *sl;
+	int used;
+
+	// 更新运行中作业的运行时间
+	for (sl = slots; sl < slots + nslot; sl++) {
+		if (sl->current) {
+			job = sl->current->job;
+			used = jobcharge(job, elapsed);
+			job->remaining_time -= used * 2 < elapsed ? elapsed : used;
+			jobpublish(job);
 		}
 	}
+	clock_ms += elapsed;
 
-	return selected;
+	// 提升到期作业的优先级
+	jobage();
 }
 
 /**
- * @brief 先来先服务(FCFS)调度算法
- * @return 选中的作业
- * @details 选择等待时间最长的作业
+ * @brief 作业cgroup中文件的路径
+ * @param buf 输出缓冲区，至少PATH_MAX字节
+ * @param jid 作业ID
+ * @param file cgroup中的文件名，NULL表示cgroup目录本身
  */
-struct waitqueue* jobselect_FCFS()
+void cgpath(char *buf, int jid, const char *file)
 {
-	struct waitqueue *p, *selected = NULL;
-	int longest_wait = -1;  // 最长等待时间初始化为-1
+	if (file == NULL)
+		snprintf(buf, PATH_MAX, "%s/job%d", cgroot, jid);
+	else
+		snprintf(buf, PATH_MAX, "%s/job%d/%s", cgroot, jid, file);
+}
 
-	// 遍历等待队列，找到等待时间最长的作业
-	for (p = head; p != NULL; p = p->next) {
-		if (p->job->wait_time > longest_wait) {
-			longest_wait = p->job->wait_time;
-			selected = p;
-		}
+/**
+ * @brief 写作业cgroup的控制文件
+ * @param job 有自己cgroup的作业
+ * @param file 控制文件名
+ * @param val 写入的内容
+ * @return 0表示成功，-1表示失败
+ */
+int cgwrite(const struct jobinfo *job, const char *file, const char *val)
+{
+	char path[PATH_MAX];
+	int fd, ret = 0;
+
+	cgpath(path, job->jid, file);
+	if ((fd = open(path, O_WRONLY|O_CLOEXEC)) < 0)
+		return -1;
+	if (write(fd, val, strlen(val)) < 0)
+		ret = -1;
+	close(fd);
+	return ret;
+}
+
+/**
+ * @brief 为作业创建cgroup
+ * @param job 尚未创建进程的作业
+ * @return 0表示成功，-1表示失败，作业改按进程组控制
+ */
+int cgcreate(struct jobinfo *job)
+{
+	char path[PATH_MAX];
+
+	cgpath(path, job->jid, NULL);
+	if (mkdir(path, 0755) < 0 && errno != EEXIST) {
+		printf("cgroup unavailable: jid=%d, %s: %s\n", job->jid, path, strerror(errno));
+		return -1;
+	}
+	job->cgroup = 1;
+	return 0;
+}
+
+/**
+ * @brief 删除已不再需要的作业cgroup
+ * @details 被终止的进程退出后cgroup才能删除，删除失败的留待调度时钟重试
+ */
+void cgreap()
+{
+	char path[PATH_MAX];
+	int i;
+
+	for (i = 0; i < ncgstale; ) {
+		cgpath(path, cgstale[i], NULL);
+		if (rmdir(path) == 0 || errno != EBUSY)
+			cgstale[i] = cgstale[--ncgstale];
+		else
+			i++;
+	}
+}
+
+/**
+ * @brief 终止作业cgroup中的进程并删除cgroup
+ * @param job 有自己cgroup的作业
+ */
+void cgremove(struct jobinfo *job)
+{
+	char path[PATH_MAX];
+
+	cgwrite(job, "cgroup.kill", "1");
+	job->cgroup = 0;
+	cgpath(path, job->jid, NULL);
+	if (rmdir(path) == 0 || errno != EBUSY)
+		return;
+
+	if (ncgstale == cgstale_cap) {
+		cgstale_cap = cgstale_cap ? cgstale_cap * 2 : 16;
+		if ((cgstale = realloc(cgstale, sizeof(*cgstale) * cgstale_cap)) == NULL)
+			error_sys("realloc failed");
 	}
+	cgstale[ncgstale++] = job->jid;
+}
+
+/**
+ * @brief 向作业的进程组发送信号
+ * @param job 已创建进程的作业
+ * @param sig 信号
+ * @details 进程组已不存在（作业进程未能成为组长）时只发给作业进程，有pidfd时通过pidfd发送。
+ *          已回收的作业（DONE）只发给进程组：它的进程号可能已分配给无关的进程
+ */
+void jobsignal(struct jobinfo *job, int sig)
+{
+	if (kill(-job->pid, sig) == 0 || errno != ESRCH || job->state == DONE)
+		return;
+	if (job->pidfd >= 0)
+		syscall(SYS_pidfd_send_signal, job->pidfd, sig, NULL, 0);
+	else
+		kill(job->pid, sig);
+}
+
+/**
+ * @brief 暂停作业的整个进程树
+ * @param job 已创建进程的作业
+ * @details 有cgroup时冻结cgroup，一次操作覆盖所有子孙进程，包括另立进程组的；
+ *          否则向进程组发送SIGSTOP
+ */
+void jobstop(struct jobinfo *job)
+{
+	jobtrace(TRACE_STOP, job, 0);
+	if (job->cgroup && cgwrite(job, "cgroup.freeze", "1") == 0)
+		return;
+	jobsignal(job, SIGSTOP);
+}
 
-	return selected;
+/**
+ * @brief 恢复作业的整个进程树
+ * @param job 已创建进程的作业
+ */
+void jobcont(struct jobinfo *job)
+{
+	jobtrace(TRACE_CONT, job, 0);
+	if (job->cgroup && cgwrite(job, "cgroup.freeze", "0") == 0)
+		return;
+	jobsignal(job, SIGCONT);
+}
+
+/**
+ * @brief 终止作业的整个进程树
+ * @param job 已创建进程的作业
+ * @details cgroup.kill需要Linux 5.14，不支持时向进程组发送SIGKILL
+ */
+void jobkill(struct jobinfo *job)
+{
+	if (job->cgroup && cgwrite(job, "cgroup.kill", "1") == 0)
+		return;
+	jobsignal(job, SIGKILL);
 }
 
 /**
- * @brief 短作业优先(SJF)调度算法
- * @return 选中的作业
- * @details 非抢占式实现，选择预计运行时间最短的作业
+ * @brief 为作业进程打开pidfd并注册到事件循环
+ * @param job 刚创建进程的作业
+ * @details 内核不支持pidfd时作业进程只通过SIGCHLD回收
  */
-struct waitqueue* jobselect_SJF()
+void jobwatch(struct jobinfo *job)
 {
-	struct waitqueue *p, *selected = NULL;
-	int shortest_duration = 0x7fffffff;  // 最短运行时间初始化为最大整数
+	struct epoll_event ev;
 
-	// 遍历等待队列，找到预计运行时间最短的作业
-	for (p = head; p != NULL; p = p->next) {
-		// 如果找到运行时间更短的作业，或者运行时间相同但等待时间更长
-		if (p->job->duration < shortest_duration || 
-			(p->job->duration == shortest_duration && 
-			 p->job->wait_time > selected->job->wait_time)) {
-			shortest_duration = p->job->duration;
-			selected = p;
+	if ((job->pidfd = syscall(SYS_pidfd_open, job->pid, 0)) < 0)
+		return;
+
+	memset(&ev, 0, sizeof(ev));
+	ev.events = EPOLLIN;
+	ev.data.u64 = EV_TAG(EV_PIDFD, 0, job->jid);
+	if (epoll_ctl(epfd, EPOLL_CTL_ADD, job->pidfd, &ev) < 0) {
+		perror("epoll_ctl pidfd");
+		close(job->pidfd);
+		job->pidfd = -1;
+		return;
+	}
+}
+
+/**
+ * @brief 创建作业进程
+ * @param job 尚未创建进程的作业
+ * @return 0表示成功，-1表示无法创建进程或执行程序
+ * @details 作业首次被调度时调用，子进程绑定到作业所在执行槽的CPU后直接执行程序，
+ *          不再先停下等待SIGCONT。通常由启动进程创建，启动进程不可用或参数过长时
+ *          才由调度器自己fork。作业进程自成进程组，指定了cgroup目录时还加入自己的cgroup
+ */
+int jobspawn(struct jobinfo *job)
+{
+	char procs[PATH_MAX], *cgprocs = NULL;
+	char pidstr[16];
+	int pid, cgerr;
+
+	if (cgroot != NULL && cgcreate(job) == 0) {
+		cgpath(procs, job->jid, "cgroup.procs");
+		cgprocs = procs;
+	}
+
+	pid = launcher_spawn(launchfd, slots[job->slot].cpu, cgprocs, job->cmdarg, &cgerr);
+	if (pid == -1) {
+		printf("exec failed: jid=%d, %s: %s\n", job->jid, job->cmdarg[0], strerror(errno));
+		return -1;
+	}
+	if (pid > 0) {
+		if (cgerr != 0) {
+			printf("cgroup join failed: jid=%d: %s\n", job->jid, strerror(cgerr));
+			cgremove(job);
 		}
+		goto spawned;
+	}
+
+	if ((pid = fork()) < 0) {
+		perror("fork");
+		return -1;
 	}
 
-	return selected;
+	if (pid == 0) {  // 子进程
+		// 恢复调度器启动前的信号屏蔽字，作业不应继承被屏蔽的SIGCHLD等信号
+		sigprocmask(SIG_SETMASK, &oldmask, NULL);
+		setpgid(0, 0);
+		if (cgprocs != NULL)
+			cgroup_join(cgprocs);
+		jobpin(0, slots[job->slot].cpu);
+
+#ifdef DEBUG
+		int i;
+		printf("begin running\n");
+		for (i = 0; job->cmdarg[i] != NULL; i++)
+			printf("arglist %s\n", job->cmdarg[i]);
+#endif
+
+		// 重定向输出并执行程序
+		dup2(globalfd,1);
+		if (execv(job->cmdarg[0], job->cmdarg) < 0)
+			printf("exec failed\n");
+
+		exit(1);
+	}
+
+	// 父进程也设置一次，不论子进程是否已执行到setpgid，返回后进程组都已存在；
+	// 同样再把子进程写入cgroup，写入已在其中的进程不会出错，失败说明无法加入
+	setpgid(pid, pid);
+	if (cgprocs != NULL) {
+		snprintf(pidstr, sizeof(pidstr), "%d", pid);
+		if (cgwrite(job, "cgroup.procs", pidstr) < 0) {
+			printf("cgroup join failed: jid=%d: %s\n", job->jid, strerror(errno));
+			cgremove(job);
+		}
+	}
+
+spawned:   // 父进程
+	job->pid = pid;
+	if (clock_getcpuclockid(pid, &job->cpuclock) != 0)
+		job->cpuclock = -1;
+	if (job->cgroup) {
+		cgpath(procs, job->jid, "cpu.stat");
+		job->cpufd = open(procs, O_RDONLY|O_CLOEXEC);
+	}
+	index_insert(&pidindex, pid, job);
+	jobwatch(job);
+	jobtrace(TRACE_SPAWN, job, 0);
+	printf("spawn job: jid=%d, pid=%d\n", job->jid, pid);
+	return 0;
 }
 
 /**
- * @brief 时间片轮转调度算法
- * @return 选中的作业
- * @details 选择等待时间最长的作业
+ * @brief 启动或恢复作业
+ * @param job 作业
+ * @return 0表示成功，-1表示无法创建进程
  */
-struct waitqueue* jobselect_RR() {
-    struct waitqueue* selected = NULL;
-    struct waitqueue* current = head;
-    
-    // 如果队列为空，返回NULL
-    if (current == NULL) {
-        return NULL;
-    }
-    
-    // 选择队首作业
-    selected = current;
-    
-    // 将选中的作业移到队尾
-    if (current->next != NULL) {
-        head = current->next;
-        struct waitqueue* tail = head;
-        while (tail->next != NULL) {
-            tail = tail->next;
-        }
-        tail->next = selected;
-        selected->next = NULL;
-    }
-    
-    return selected;
+int jobresume(struct jobinfo *job)
+{
+	if (job->pid == 0)
+		return jobspawn(job);
+	jobcont(job);
+	return 0;
 }
 
 /**
- * @brief 最高响应比优先调度算法
- * @return 选中的作业
- * @details 选择响应比最高的作业
+ * @brief 作业在就绪队列中等待的总时间
+ * @param job 作业
+ * @return 调度时钟毫秒数，运行中的作业取开始运行时的值，不再增长
  */
-struct waitqueue* jobselect_HRRN() {
-    struct waitqueue* selected = NULL;
-    struct waitqueue* current = head;
-    float highest_ratio = -1.0;
-    struct waitqueue* prev = NULL;
-    struct waitqueue* selected_prev = NULL;
-    
-    // 如果队列为空，返回NULL
-    if (current == NULL) {
-        return NULL;
-    }
-    
-    // 计算当前时间
-    struct timeval current_time;
-    gettimeofday(&current_time, NULL);
-    
-    // 遍历队列找到响应比最高的作业
-    while (current != NULL) {
-        float wait_time = difftime(current_time.tv_sec, current->job->arrival_time);
-        float response_ratio = (wait_time + current->job->duration) / current->job->duration;
-        
-        if (response_ratio > highest_ratio) {
-            highest_ratio = response_ratio;
-            selected = current;
-            selected_prev = prev;
-        }
-        
-        prev = current;
-        current = current->next;
-    }
-    
-    // 从队列中移除选中的作业
-    if (selected_prev != NULL) {
-        selected_prev->next = selected->next;
-    } else {
-        head = selected->next;
-    }
-    selected->next = NULL;
-    
-    return selected;
+long jobwait(const struct jobinfo *job)
+{
+	return job->state == RUNNING ? job->wait_time : clock_ms - job->wait_base;
 }
 
 /**
- * @brief 多级反馈队列调度算法
- * @return 选中的作业
- * @details 选择优先级最高的作业
+ * @brief 作业结束等待、开始运行时的记账
+ * @param job 作业
+ * @param now 当前单调时钟（单位：纳秒）
  */
-struct waitqueue* jobselect_MLFQ() {
-    struct waitqueue* selected = NULL;
-    struct waitqueue* current = head;
-    
-    // 如果队列为空，返回NULL
-    if (current == NULL) {
-        return NULL;
-    }
-    
-    // 从当前队列开始查找
-    for (int i = 0; i < MAX_QUEUES; i++) {
-        int queue_index = (current_queue + i) % MAX_QUEUES;
-        struct waitqueue* current = head;
-        struct waitqueue* prev = NULL;
-        
-        // 在当前队列中查找作业
-        while (current != NULL) {
-            if (current->job->priority == queue_index) {
-                selected = current;
-                
-                // 从队列中移除选中的作业
-                if (prev != NULL) {
-                    prev->next = selected->next;
-                } else {
-                    head = selected->next;
-                }
-                selected->next = NULL;
-                
-                // 如果作业未完成，降低其优先级
-                if (selected->job->remaining_time > TIME_QUANTUM) {
-                    selected->job->priority = (queue_index + 1) % MAX_QUEUES;
-                }
-                
-                // 更新当前队列索引
-                current_queue = (queue_index + 1) % MAX_QUEUES;
-                return selected;
-            }
-            
-            prev = current;
-            current = current->next;
-        }
-    }
-    
-    return NULL;
+void jobready(struct jobinfo *job, uint64_t now)
+{
+	job->wait_time = clock_ms - job->wait_base;
+	job->queued_ns += now - job->ready_ns;
+	if (job->first_ns == 0)
+		job->first_ns = now;
 }
 
+/**
+ * @brief 记录已结束作业的各项延迟
+ * @param job 作业
+ * @details 计入全部作业和作业所有者的直方图，所有者超过LAT_MAXOWNERS个后
+ *          新出现的所有者只计入全部作业
+ */
+void jobrecord(struct jobinfo *job)
+{
+	struct latset *sets[2] = { &lat_all, NULL };
+	uint64_t now = now_ns(), turnaround, service, v[LAT_NMETRIC];
+	int i, m;
+
+	// 被外部终止的等待中作业，等待时间算到结束为止
+	if (job->state == READY)
+		jobready(job, now);
+	turnaround = now - job->submit_ns;
+	v[LAT_QUEUE] = job->queued_ns / 1000;
+	v[LAT_RESPONSE] = job->first_ns != 0 ? (job->first_ns - job->submit_ns) / 1000 : turnaround / 1000;
+	v[LAT_TURNAROUND] = turnaround / 1000;
+	// 服务时间取实际使用的CPU时间，并行运行或阻塞的作业不会因墙上时间而少算减速比
+	service = job->cpu_ns > SLOWDOWN_MIN_NS ? job->cpu_ns : SLOWDOWN_MIN_NS;
+	v[LAT_SLOWDOWN] = turnaround > service ? turnaround * 1000 / service : 1000;
+
+	for (i = 0; i < nlat_owner; i++)
+		if (lat_owner[i]->owner == job->ownerid)
+			break;
+	if (i == nlat_owner && nlat_owner < LAT_MAXOWNERS) {
+		if ((lat_owner[i] = calloc(1, sizeof(struct latset))) == NULL)
+			error_sys("calloc failed");
+		lat_owner[i]->owner = job->ownerid;
+		nlat_owner++;
+	}
+	if (i < nlat_owner)
+		sets[1] = lat_owner[i];
+
+	for (i = 0; i < 2 && sets[i] != NULL; i++)
+		for (m = 0; m < LAT_NMETRIC; m++)
+			hist_record(&sets[i]->h[m], v[m]);
+}
 
 /**
  * @brief 作业切换函数
- * @details 处理作业的切换、终止和启动
+ * @details 处理cur所指执行槽上作业的切换、终止和启动
  */
 void jobswitch()
 {
-    struct waitqueue *p;
-    int i;
-    
+    uint64_t now;
+    int prev;
+
     // 处理已完成的作业
-    if (current && current->job->state == DONE) {
+    if (cur->current && cur->current->job->state == DONE) {
         // 释放作业资源
-        for (i = 0; (current->job->cmdarg)[i] != NULL; i++) {
-            free((current->job->cmdarg)[i]);
-            (current->job->cmdarg)[i] = NULL;
-        }
-        
-        free(current->job->cmdarg);
-        free(current->job);
-        free(current);
-        
-        current = NULL;
+        jobfree(cur->current);
+        cur->current = NULL;
     }
-    
+
+again:
+    // 选中的仍是当前作业，继续运行
+    if (cur->next != NULL && cur->next == cur->current) {
+        cur->next = NULL;
+        return;
+    }
+
     // 处理作业切换的不同情况
-    if (next == NULL && current == NULL)          // 没有作业要运行
+    if (cur->next == NULL && cur->current == NULL)          // 没有作业要运行
         return;
     
-    else if (next != NULL && current == NULL) {   // 启动新作业
+    else if (cur->next != NULL && cur->current == NULL) {   // 启动新作业
+#ifdef DEBUG
         printf("begin start new job\n");
-        current = next;
-        next = NULL;
-        current->job->state = RUNNING;
-        kill(current->job->pid, SIGCONT);
+#endif
+        cur->current = cur->next;
+        cur->next = NULL;
+        cur->current->job->state = RUNNING;
+        jobready(cur->current->job, now_ns());
+        jobtrace(TRACE_SELECT, cur->current->job, 0);
+        if (jobresume(cur->current->job) < 0) {
+            jobtrace(TRACE_FAIL, cur->current->job, 0);
+            jobfree(cur->current);
+            cur->current = NULL;
+            // 执行槽不空闲到下一个时钟，重新选择
+            cur->next = rq_next(cur);
+            goto again;
+        }
+        jobpublish(cur->current->job);
         return;
         
-    } else if (next != NULL && current != NULL) { // 执行作业切换
+    } else if (cur->next != NULL && cur->current != NULL) { // 执行作业切换
         // 暂停当前作业
-        kill(current->job->pid, SIGSTOP);
-        current->job->state = READY;
+        now = now_ns();
+        jobstop(cur->current->job);
+        cur->current->job->state = READY;
+        cur->current->job->ready_ns = now;
+        cur->current->job->wait_base = clock_ms - cur->current->job->wait_time;
+        jobpublish(cur->current->job);
         
         // 启动新作业
-        current = next;
-        next = NULL;
-        current->job->state = RUNNING;
-        kill(current->job->pid, SIGCONT);
-        
+        prev = cur->current->job->jid;
+        cur->current = cur->next;
+        cur->next = NULL;
+        cur->current->job->state = RUNNING;
+        jobready(cur->current->job, now);
+        jobtrace(TRACE_SELECT, cur->current->job, prev);
+        if (jobresume(cur->current->job) < 0) {
+            jobtrace(TRACE_FAIL, cur->current->job, 0);
+            jobfree(cur->current);
+            cur->current = NULL;
+            // 执行槽不空闲到下一个时钟，重新选择，刚暂停的作业已在就绪队列中，可能被重新选中
+            cur->next = rq_next(cur);
+            goto again;
+        }
+        jobpublish(cur->current->job);
+
+#ifdef DEBUG
         printf("\nbegin switch: current jid=%d, pid=%d\n",
-               current->job->jid, current->job->pid);
+               cur->current->job->jid, cur->current->job->pid);
+#endif
         return;
         
     } else {    // 不需要切换
@@ -376,193 +1264,301 @@ void jobswitch()
 }
 
 /**
- * @brief 信号处理函数
- * @param sig 信号类型
- * @param info 信号信息
- * @param notused 未使用的参数
+ * @brief 回收一个已结束的子进程
+ * @param type 等待的类型（P_ALL、P_PIDFD）
+ * @param id 等待的对象
+ * @param info 输出的子进程状态，没有已结束的子进程时si_pid为0
+ * @param ru 输出的子进程资源使用
+ * @return 0表示成功，-1表示失败
+ * @details glibc的waitid()不返回资源使用，直接使用系统调用
  */
-void sig_handler(int sig, siginfo_t *info, void *notused)
+int reapchild(int type, int id, siginfo_t *info, struct rusage *ru)
 {
-	int status;
-	int ret;
+	memset(info, 0, sizeof(*info));
+	memset(ru, 0, sizeof(*ru));
+	return syscall(SYS_waitid, type, id, info, WEXITED|WNOHANG, ru);
+}
 
-	switch (sig) {
-	case SIGVTALRM:  // 定时器信号
-		schedule();
-		return;
+/**
+ * @brief 资源使用中的CPU时间
+ * @param ru 资源使用
+ * @return 用户态与内核态CPU时间之和（单位：纳秒）
+ */
+int64_t ru_ns(const struct rusage *ru)
+{
+	return ((int64_t)ru->ru_utime.tv_sec + ru->ru_stime.tv_sec) * 1000000000 +
+		((int64_t)ru->ru_utime.tv_usec + ru->ru_stime.tv_usec) * 1000;
+}
 
-	case SIGCHLD:    // 子进程状态变化信号
-		ret = waitpid(-1, &status, WNOHANG);
-		if (ret == 0 || ret == -1)
-			return;
+/**
+ * @brief 处理作业进程的结束
+ * @param job 作业
+ * @param info waitid()返回的子进程状态
+ * @param ru 回收时取得的资源使用，包括作业进程已回收的子孙进程
+ * @details 立即释放作业：运行中的作业所在的执行槽马上选择下一个作业，
+ *          不必等到下一个时钟；等待中的作业被外部终止时从就绪队列中删除
+ */
+void jobexit(struct jobinfo *job, const siginfo_t *info, const struct rusage *ru)
+{
+	struct runslot *sl;
+	int64_t cpu;
 
-		// 处理子进程的不同退出状态
-		if (WIFEXITED(status)) {  // 正常退出
-			current->job->state = DONE;
-			printf("normal termation, exit status = %d\tjid = %d, pid = %d\n\n",
-				WEXITSTATUS(status), current->job->jid, current->job->pid);
+	// 处理子进程的不同退出状态
+	if (info->si_code == CLD_EXITED) {  // 正常退出
+		printf("normal termation, exit status = %d\tjid = %d, pid = %d\n\n",
+			info->si_status, job->jid, job->pid);
 
-		}  else if (WIFSIGNALED(status)) {  // 被信号终止
-		    printf("abnormal termation, signal number = %d\tjid = %d, pid = %d\n\n",
-				WTERMSIG(status), current->job->jid, current->job->pid);
+	}  else {  // 被信号终止
+		printf("abnormal termation, signal number = %d\tjid = %d, pid = %d\n\n",
+			info->si_status, job->jid, job->pid);
+	}
 
-		} else if (WIFSTOPPED(status)) {  // 被信号停止
-		    printf("child stopped, signal number = %d\tjid = %d, pid = %d\n\n",
-				WSTOPSIG(status), current->job->jid, current->job->pid);
-		}
+	// 最后一次记账：进程已回收，它的CPU时钟不再可用，进程号也可能已被复用，
+	// 有cgroup时读cpu.stat，否则取回收时的资源使用
+	job->cpuclock = -1;
+	cpu = jobcputime(job);
+	if (cpu < ru_ns(ru))
+		cpu = ru_ns(ru);
+	if ((uint64_t)cpu > job->cpu_ns) {
+		job->cpu_ns = cpu;
+		job->run_time = cpu / 1000000;
+	}
+
+	jobrecord(job);
+	jobtrace(TRACE_EXIT, job, info->si_code == CLD_EXITED ? info->si_status : -info->si_status);
+	sl = &slots[job->slot];
+	if (sl->current == &job->node) {
+		job->state = DONE;
+		dispatch(sl);
+	} else {
+		rq_remove(sl, &job->node);
+		job->state = DONE;   // 已回收，释放时不再按进程号发信号
+		jobfree(&job->node);
+	}
+}
+
+/**
+ * @brief pidfd可读处理函数
+ * @param jid pidfd所属作业的ID
+ * @details pidfd可读表示对应的作业进程已结束，按pidfd回收它
+ */
+void do_pidfd(int jid)
+{
+	struct jobinfo *job;
+	struct rusage ru;
+	siginfo_t info;
+
+	// 作业可能已在同一批事件中被SIGCHLD回收或被出队释放
+	if ((job = index_find(&jidindex, jid)) == NULL || job->pidfd < 0)
 		return;
 
-	default:
+	if (reapchild(P_PIDFD, job->pidfd, &info, &ru) < 0 || info.si_pid == 0)
 		return;
+	jobexit(job, &info, &ru);
+}
+
+/**
+ * @brief 子进程状态变化处理函数
+ * @details 由信号文件描述符上的SIGCHLD触发，运行在普通上下文中。
+ *          作业进程通常由各自的pidfd回收，这里回收其余子进程：内核不支持pidfd时的作业、
+ *          已出队的作业、执行失败的进程和启动进程。多个子进程的SIGCHLD可能合并为一个，
+ *          所以回收所有已结束的子进程，并按进程号找到对应的作业
+ */
+void do_sigchld()
+{
+	struct jobinfo *job;
+	struct rusage ru;
+	siginfo_t info;
+
+	for (;;) {
+		if (reapchild(P_ALL, 0, &info, &ru) < 0 || info.si_pid == 0)
+			break;
+
+		// 已被出队终止的作业不再有记录
+		if ((job = index_find(&pidindex, info.si_pid)) == NULL)
+			continue;
+		jobexit(job, &info, &ru);
+	}
+}
+
+/**
+ * @brief 信号处理函数
+ * @details 从信号文件描述符读出所有待处理信号并分发
+ */
+void do_signal()
+{
+	struct signalfd_siginfo si;
+	ssize_t n;
+
+	while ((n = read(sigfd, &si, sizeof(si))) == sizeof(si)) {
+		switch (si.ssi_signo) {
+		case SIGCHLD:    // 子进程状态变化信号
+			do_sigchld();
+			break;
+		case SIGINT:     // 终止调度器
+		case SIGTERM:
+			siginfo = 0;
+			break;
+		default:
+			break;
+		}
 	}
+	if (n < 0 && errno != EAGAIN && errno != EINTR)
+		error_sys("read signalfd failed");
+}
+
+/**
+ * @brief 调度时钟处理函数
+ * @details 按单调时钟实际流逝的时间记账，而不是按到期次数；
+ *          不足1毫秒的余数留到下次，长期运行也不会丢失时间
+ */
+void do_tick()
+{
+	uint64_t expired, now;
+	int elapsed;
+
+	if (read(timerfd, &expired, sizeof(expired)) != sizeof(expired)) {
+		if (errno == EAGAIN || errno == EINTR)
+			return;
+		error_sys("read timerfd failed");
+	}
+
+#ifdef DEBUG
+	if (expired > 1)
+		printf("tick overrun: %llu quanta\n", (unsigned long long)expired);
+#endif
+
+	now = now_ns();
+	elapsed = (now - last_tick) / 1000000ULL;
+	last_tick += (uint64_t)elapsed * 1000000ULL;
+	schedule(elapsed);
+	if (jobtab != NULL)
+		jobtab_clock(jobtab, clock_ms);
+	if (ncgstale > 0)
+		cgreap();
+
+	// 没有作业时停止时钟
+	if (jobs.count == 0)
+		timer_disarm();
 }
 
 /**
  * @brief 作业入队处理函数
- * @param newjob 新作业信息
  * @param enqcmd 入队命令
+ * @return 新作业ID，参数非法时返回-1
  */
-void do_enq(struct jobinfo *newjob, struct jobcmd enqcmd)
+int do_enq(const struct jobcmd *enqcmd)
 {
-	struct	waitqueue *newnode, *p;
-	int		i=0, pid;
-	char	*offset, *argvec, *q;
+	struct	jobinfo *newjob;
+	int		i;
+	char	*q;
 	char	**arglist;
-	sigset_t	zeromask;
 	time_t current_time;
 
-	sigemptyset(&zeromask);
+	// 校验参数范围，与enq命令的检查一致
+	if (enqcmd->defpri < 0 || enqcmd->defpri > 3 ||
+	    enqcmd->duration < 0 || enqcmd->duration > 65535) {
+		printf("invalid enq command: priority %d, duration %d\n",
+			enqcmd->defpri, enqcmd->duration);
+		return -1;
+	}
 
 	// 获取当前时间
 	time(&current_time);
 
-	// 创建新作业
-	newjob = (struct jobinfo *)malloc(sizeof(struct jobinfo));
-	if (newjob == NULL)
-		error_sys("malloc failed");
+	// 从内存池中分配新作业
+	newjob = job_alloc();
 
 	// 初始化作业信息
 	newjob->jid = allocjid();
-	newjob->defpri = enqcmd.defpri;
-	newjob->curpri = enqcmd.defpri;
-	newjob->ownerid = enqcmd.owner;
-	newjob->state = READY;
-	newjob->run_time = 0;
-	newjob->wait_time = 0;
-	newjob->wait_time_hrrf = 0;
+	newjob->defpri = enqcmd->defpri;
+	newjob->ownerid = enqcmd->owner;
 	newjob->create_time = current_time;
 	newjob->arrival_time = current_time;  // 设置到达时间
-	newjob->duration = enqcmd.duration;
+	newjob->duration = enqcmd->duration;
+	newjob->pidfd = -1;
+	newjob->cgroup = 0;
+	newjob->cpu_ns = 0;
+	newjob->cpufd = -1;
+	newjob->tabrow = jobtab != NULL ? jobtab_alloc(jobtab) : -1;
+	newjob->submit_ns = now_ns();
+	newjob->first_ns = 0;
+	newjob->ready_ns = newjob->submit_ns;
+	newjob->queued_ns = 0;
+	newjob->wait_base = clock_ms;
+	newjob->wait_time = 0;
 
-	// 处理命令行参数
-	arglist = (char**)malloc(sizeof(char*)*(enqcmd.argnum+1));
+	// 处理命令行参数：指针数组和参数字符串放在同一块参数区中，一次释放
+	arglist = blob_alloc(sizeof(char*)*(enqcmd->argnum+1) + enqcmd->arglen);
 	newjob->cmdarg = arglist;
-	offset = enqcmd.data;
-	argvec = enqcmd.data;
-	while (i < enqcmd.argnum) {
-		if (*offset == ':') {
-			*offset++ = '\0';
-			q = (char*)malloc(offset - argvec);
-			strcpy(q,argvec);
-			arglist[i++] = q;
-			argvec = offset;
-		} else
-			offset++;
+	q = (char*)(arglist + enqcmd->argnum + 1);
+	memcpy(q, enqcmd->args, enqcmd->arglen);
+	for (i = 0; i < enqcmd->argnum; i++) {
+		arglist[i] = q;
+		q += strlen(q) + 1;
 	}
 	arglist[i] = NULL;
 
 #ifdef DEBUG
 	// 调试信息输出
-	printf("enqcmd argnum %d\n",enqcmd.argnum);
-	for (i = 0; i < enqcmd.argnum; i++)
+	printf("enqcmd argnum %d\n",enqcmd->argnum);
+	for (i = 0; i < enqcmd->argnum; i++)
 		printf("parse enqcmd:%s\n",arglist[i]);
 #endif
 
-	// 将新作业添加到等待队列
-	newnode = (struct waitqueue*)malloc(sizeof(struct waitqueue));
-	newnode->next = NULL;
-	newnode->job = newjob;
-
-	if (head) {
-		for (p = head; p->next != NULL; p = p->next);
-		p->next = newnode;
-	} else
-		head = newnode;
-
-	// 创建子进程运行作业
-	if ((pid = fork()) < 0)
-		error_sys("enq fork failed");
-
-	if (pid == 0) {  // 子进程
-		newjob->pid = getpid();
-		raise(SIGSTOP);  // 暂停等待调度
-
-#ifdef DEBUG
-		printf("begin running\n");
-		for (i = 0; arglist[i] != NULL; i++)
-			printf("arglist %s\n",arglist[i]);
-#endif
-
-		// 重定向输出并执行程序
-		dup2(globalfd,1);
-		if (execv(arglist[0],arglist) < 0)
-			printf("exec failed\n");
-
-		exit(1);
-	} else {  // 父进程
-		newjob->pid = pid;
-		printf("\nnew job: jid=%d, pid=%d\n", newjob->jid, newjob->pid);
-	}
+	// 作业在首次被调度时才创建进程，排队期间只是一条记录
+	newjob->pid = 0;
+
+	// 放到负载最轻的执行槽上，再添加到作业链表
+	jobadmit(newjob, slot_pick());
+	queue_push(&jobs, &newjob->node);
+	index_insert(&jidindex, newjob->jid, newjob);
+	jobpublish(newjob);
+	jobtrace(TRACE_ENQ, newjob, newjob->defpri);
+	printf("\nnew job: jid=%d\n", newjob->jid);
+	return newjob->jid;
 }
 
 /**
  * @brief 作业出队处理函数
  * @param deqcmd 出队命令
+ * @return 0表示已终止，-1表示没有该作业
  */
-void do_deq(struct jobcmd deqcmd)
+int do_deq(const struct jobcmd *deqcmd)
 {
-    int deqid, i;
-    struct waitqueue *p, *prev, *select, *selectprev;
+    int deqid;
+    struct jobinfo *job;
+    struct waitqueue *select;
+    struct runslot *sl;
 
-    deqid = atoi(deqcmd.data);
+    deqid = deqcmd->jid;
 
 #ifdef DEBUG
     printf("deq jid %d\n", deqid);
 #endif
 
-    // 在等待队列中查找要终止的作业
-    select = NULL;
-    selectprev = NULL;
-    for (p = head, prev = NULL; p != NULL; prev = p, p = p->next) {
-        if (p->job->jid == deqid) {
-            select = p;
-            selectprev = prev;
-            break;
-        }
-    }
+    // 按作业ID查找要终止的作业
+    job = index_find(&jidindex, deqid);
 
     // 如果找到要终止的作业
-    if (select != NULL) {
-        // 从等待队列中移除
-        if (selectprev == NULL) {
-            head = select->next;
-        } else {
-            selectprev->next = select->next;
-        }
+    if (job != NULL) {
+        select = &job->node;
+        sl = &slots[job->slot];
+        jobtrace(TRACE_DEQ, job, job->state);
 
-        // 终止作业进程
-        kill(select->job->pid, SIGKILL);
-        
-        // 释放资源
-        for (i = 0; (select->job->cmdarg)[i] != NULL; i++) {
-            free((select->job->cmdarg)[i]);
-        }
-        free(select->job->cmdarg);
-        free(select->job);
-        free(select);
+        // 运行中的作业不在就绪队列中
+        if (select == sl->current)
+            sl->current = NULL;
+        else
+            rq_remove(sl, select);
+
+        // 释放资源，同时终止作业的整个进程树；尚未调度过的作业还没有进程
+        jobfree(select);
 
         printf("terminate job %d\n", deqid);
+        return 0;
     }
+    return -1;
 }
 
 /**
@@ -571,22 +1567,27 @@ void do_deq(struct jobcmd deqcmd)
  */
 void do_stat()
 {
-	struct waitqueue *p;
+	struct waitqueue *p, *current;
 	char timebuf[BUFLEN];
+	int64_t cpu;
+	int i;
 
 	// 打印表头
 	printf("JID\tPID\tOWNER\tRUNTIME\tWAITTIME\tCREATTIME\tSTATE\tDEFPRI\tCURPRI\n");
 
-	// 显示当前运行作业的信息
-	if (current) {
+	// 显示各执行槽上运行作业的信息，运行时间取当前实际使用的CPU时间
+	for (i = 0; i < nslot; i++) {
+		if ((current = slots[i].current) == NULL)
+			continue;
+		cpu = jobcputime(current->job);
 		strcpy(timebuf,ctime(&(current->job->create_time)));
 		timebuf[strlen(timebuf) - 1] = '\0';
-		printf("%d\t%d\t%d\t%d\t%d\t%s\t%d\t%d\t%d\n",
+		printf("%d\t%d\t%d\t%d\t%ld\t%s\t%d\t%d\t%d\n",
 			current->job->jid,
 			current->job->pid,
 			current->job->ownerid,
-			current->job->run_time,
-			current->job->wait_time,
+			cpu > (int64_t)current->job->cpu_ns ? (int)(cpu / 1000000) : current->job->run_time,
+			jobwait(current->job),
 			timebuf,
 			current->job->state,
             current->job->defpri,
@@ -594,16 +1595,18 @@ void do_stat()
             );
 	}
 
-	// 显示等待队列中作业的信息
-	for (p = head; p != NULL; p = p->next) {
+	// 显示等待中作业的信息
+	for (p = jobs.head; p != NULL; p = p->next) {
+		if (p == slots[p->job->slot].current)
+			continue;
 		strcpy(timebuf,ctime(&(p->job->create_time)));
 		timebuf[strlen(timebuf) - 1] = '\0';
-		printf("%d\t%d\t%d\t%d\t%d\t%s\t%d\t%d\t%d\n",
+		printf("%d\t%d\t%d\t%d\t%ld\t%s\t%d\t%d\t%d\n",
 			p->job->jid,
 			p->job->pid,
 			p->job->ownerid,
 			p->job->run_time,
-			p->job->wait_time,
+			jobwait(p->job),
 			timebuf,
 			p->job->state,
             p->job->defpri,
@@ -614,16 +1617,139 @@ void do_stat()
 	printf("\n");
 }
 
+/**
+ * @brief 延迟统计查询函数
+ * @details 显示全部已结束作业和各所有者的延迟百分位
+ */
+void do_latency()
+{
+	static const char *metrics[LAT_NMETRIC] = { "QUEUE", "RESPONSE", "TURNAROUND", "SLOWDOWN" };
+	static const char *units[LAT_NMETRIC] = { "us", "us", "us", "x1000" };
+	struct latrow rows[(LAT_MAXOWNERS + 1) * LAT_NMETRIC];
+	int i, n;
+
+	n = lat_rows(rows);
+	printf("POLICY %s\n", policy_name);
+	printf("OWNER\tMETRIC\t\tUNIT\tCOUNT\tP50\tP99\tP999\tMAX\n");
+	for (i = 0; i < n; i++) {
+		if (rows[i].owner == LAT_ALLOWNERS)
+			printf("all");
+		else
+			printf("%d", rows[i].owner);
+		printf("\t%-10s\t%s\t%llu\t%llu\t%llu\t%llu\t%llu\n",
+			metrics[rows[i].metric], units[rows[i].metric],
+			(unsigned long long)rows[i].count, (unsigned long long)rows[i].p50,
+			(unsigned long long)rows[i].p99, (unsigned long long)rows[i].p999,
+			(unsigned long long)rows[i].max);
+	}
+	printf("\n");
+}
+
+/**
+ * @brief 显示命令使用说明
+ */
+void usage()
+{
+	printf("Usage:  scheduler [-q ms] [-m ms,ms,ms] [-n slots] [-c cgroup] [-t events]\n"
+		"\t-q ms\t\t scheduling quantum in milliseconds (%d-%d),\n"
+		"\t\t\t defaults to the chosen algorithm's quantum\n"
+		"\t-m ms,ms,ms\t MLFQ quantum of each level, top level first\n"
+		"\t\t\t (defaults to %d,%d,%d); the scheduling quantum of MLFQ\n"
+		"\t\t\t defaults to the top level's quantum\n"
+		"\t-n slots\t run up to this many jobs at once, each slot pinned\n"
+		"\t\t\t to one of the allowed CPUs (defaults to 1, unpinned)\n"
+		"\t-c cgroup\t writable cgroup v2 directory; each job gets its own\n"
+		"\t\t\t child cgroup and is frozen instead of signalled\n"
+		"\t-t events\t record scheduling events in a ring of this many\n"
+		"\t\t\t entries (%d-%d) in /dev/shm%s; export with trace2json\n",
+		QUANTUM_MIN, QUANTUM_MAX,
+		mlfq_quantum[0], mlfq_quantum[1], mlfq_quantum[2],
+		TRACE_MINEVENTS, TRACE_MAXEVENTS, TRACE_NAME);
+}
+
 /**
  * @brief 主函数
- * @details 初始化调度器，设置信号处理，启动调度循环
+ * @param argc 命令行参数数量
+ * @param argv 命令行参数数组
+ * @details 初始化调度器，建立事件循环：FIFO命令、调度时钟和信号都通过epoll等待，空闲时不占用CPU
  */
-int main()
+int main(int argc, char *argv[])
 {
-	struct timeval interval;
-	struct itimerval new, old;
 	struct stat statbuf;
-	struct sigaction newact, oldact1, oldact2;
+	struct epoll_event ev, events[8];
+	uint64_t tag;
+	sigset_t mask;
+	cpu_set_t cpus;
+	int i, n, c;
+	char *arg, *end;
+	int traceevents = 0;
+
+	// 解析命令行选项
+	quantum = 0;
+	while ((c = getopt(argc, argv, "q:m:n:c:t:")) != -1) {
+		switch (c) {
+		case 'q':  // 指定时间片
+			quantum = atoi(optarg);
+			if (quantum < QUANTUM_MIN || quantum > QUANTUM_MAX) {
+				printf("invalid quantum: must between %d and %d ms\n",
+					QUANTUM_MIN, QUANTUM_MAX);
+				return 1;
+			}
+			break;
+		case 'm':  // 指定多级反馈队列各级时间片
+			for (i = 0, arg = optarg; i < MLFQ_LEVELS; i++, arg = end + 1) {
+				mlfq_quantum[i] = strtol(arg, &end, 10);
+				if (end == arg || mlfq_quantum[i] < QUANTUM_MIN ||
+				    mlfq_quantum[i] > QUANTUM_MAX ||
+				    *end != (i < MLFQ_LEVELS - 1 ? ',' : '\0')) {
+					printf("invalid MLFQ quanta: need %d values between %d and %d ms\n",
+						MLFQ_LEVELS, QUANTUM_MIN, QUANTUM_MAX);
+					return 1;
+				}
+			}
+			break;
+		case 'n':  // 指定执行槽个数
+			nslot = atoi(optarg);
+			if (nslot < 1 || nslot > CPU_SETSIZE) {
+				printf("invalid slot count: must between 1 and %d\n", CPU_SETSIZE);
+				return 1;
+			}
+			break;
+		case 'c':  // 指定作业cgroup的父目录
+			cgroot = optarg;
+			break;
+		case 't':  // 启用调度事件跟踪，指定跟踪环容量
+			traceevents = atoi(optarg);
+			if (traceevents < TRACE_MINEVENTS || traceevents > TRACE_MAXEVENTS) {
+				printf("invalid trace size: must between %d and %d events\n",
+					TRACE_MINEVENTS, TRACE_MAXEVENTS);
+				return 1;
+			}
+			break;
+		default:
+			usage();
+			return 1;
+		}
+	}
+
+	// 作业cgroup的父目录须是可写的cgroup v2目录，否则只按进程组控制作业
+	if (cgroot != NULL) {
+		char path[PATH_MAX];
+
+		snprintf(path, sizeof(path), "%s/cgroup.procs", cgroot);
+		if (access(cgroot, W_OK) < 0 || access(path, F_OK) < 0) {
+			printf("cgroup %s not writable, jobs will be controlled by process group\n", cgroot);
+			cgroot = NULL;
+		}
+	}
+
+	// 打开全局输出文件
+	if ((globalfd = open("/dev/null", O_WRONLY|O_CLOEXEC)) < 0)
+		error_sys("open global file failed");
+
+	// 在打开其他文件、分配大量内存之前创建作业启动进程，失败时由调度器自己fork
+	if ((launchfd = launcher_start(globalfd)) < 0)
+		printf("launcher unavailable, jobs will be forked by the scheduler\n");
 
 	// 初始化FIFO
 	if (stat(FIFO, &statbuf) == 0) {
@@ -634,76 +1760,150 @@ int main()
 	if (mkfifo(FIFO, 0666) < 0)
 		error_sys("mkfifo failed");
 
+	// 命令接收缓冲区
+	if ((ingest_buf = malloc(INGEST_BUFLEN)) == NULL)
+		error_sys("malloc failed");
+	ingest_cap = INGEST_BUFLEN;
+
 	// 以非阻塞方式打开FIFO
-	if ((fifo = open(FIFO, O_RDONLY|O_NONBLOCK)) < 0)
+	if ((fifo = open(FIFO, O_RDONLY|O_NONBLOCK|O_CLOEXEC)) < 0)
 		error_sys("open fifo failed");
 
-	// 打开全局输出文件
-	if ((globalfd = open("/dev/null", O_WRONLY)) < 0)
-		error_sys("open global file failed");
+	// 自己持有一个写端，否则客户端关闭后epoll会不停报告EPOLLHUP
+	if ((fifo_keep = open(FIFO, O_WRONLY|O_NONBLOCK|O_CLOEXEC)) < 0)
+		error_sys("open fifo failed");
+
+	// 控制套接字，失败时客户端退回到FIFO
+	if (ctl_listen() < 0)
+		printf("control socket unavailable, commands only through the fifo\n");
 
     // 选择调度算法
     printf("=====Choose algorithm of Select_Job=====\n");
-    printf("(1) HPF\n");
-    printf("(2) FCFS\n");
-    printf("(3) SJF\n");
-    printf("(4) RR\n");
-    printf("(5) HRRN\n");
-    printf("(6) MLFQ\n");
+    for (i = 0; i < NPOLICY; i++)
+        printf("(%d) %s\n", i + 1, policies[i].name);
     int tmp_choose;
-    scanf("%d", &tmp_choose);
-    switch(tmp_choose) {
-        case 1:
-            jobselect = jobselect_HPF;
-            break;
-        case 2:
-            jobselect = jobselect_FCFS;
-            break;
-        case 3:
-            jobselect = jobselect_SJF;
-            break;
-        case 4:
-            jobselect = jobselect_RR;
-            break;
-        case 5:
-            jobselect = jobselect_HRRN;
-            break;
-        case 6:
-            jobselect = jobselect_MLFQ;
-            break;
-        default:
-            printf("Invalidly Input!");
-            exit(0);
+    if (scanf("%d", &tmp_choose) != 1 || tmp_choose < 1 || tmp_choose > NPOLICY) {
+        printf("Invalidly Input!");
+        exit(0);
+    }
+    policy_use(&policies[tmp_choose - 1]);
+    policy_name = policies[tmp_choose - 1].name;
+    if (quantum == 0)
+        quantum = policy_quantum(&policies[tmp_choose - 1]);
+
+    // 初始化执行槽，多于一个时依次绑定到允许使用的CPU上
+    slots_init(nslot);
+    if (sched_getaffinity(0, sizeof(cpus), &cpus) < 0)
+        error_sys("sched_getaffinity failed");
+    for (i = 0, c = 0; nslot > 1 && i < nslot; i++) {
+        while (!CPU_ISSET(c % CPU_SETSIZE, &cpus))
+            c++;
+        slots[i].cpu = c++ % CPU_SETSIZE;
+        if (c >= CPU_SETSIZE)
+            c = 0;
     }
 
-    // 设置信号处理器
-    newact.sa_sigaction = sig_handler;
-    newact.sa_flags = SA_SIGINFO;
-    sigemptyset(&newact.sa_mask);
-
-    // 安装SIGVTALRM信号处理器
-    if (sigaction(SIGVTALRM, &newact, &oldact1) < 0)
-        error_sys("sigaction SIGVTALRM failed");
-
-    // 安装SIGCHLD信号处理器
-    if (sigaction(SIGCHLD, &newact, &oldact2) < 0)
-        error_sys("sigaction SIGCHLD failed");
-
-    // 设置定时器
-    interval.tv_sec = 1;
-    interval.tv_usec = 0;  // 响应机制为1s
-
-    new.it_interval = interval;
-    new.it_value = interval;
-    setitimer(ITIMER_VIRTUAL, &new, &old);
-
-    printf("OK! Scheduler is starting now!!\n");
+    // 发布共享内存作业表，失败时stat命令退回到经FIFO查询
+    if ((jobtab = jobtab_create(policies[tmp_choose - 1].name, nslot)) == NULL)
+        printf("job table unavailable, stat will go through the fifo\n");
+
+    // 创建调度事件跟踪环，失败时不跟踪
+    if (traceevents > 0 &&
+        (tracer = trace_create(policies[tmp_choose - 1].name, nslot, traceevents)) == NULL)
+        printf("trace ring unavailable, scheduling events will not be recorded\n");
+
+    // 屏蔽SIGCHLD、SIGINT、SIGTERM，改由信号文件描述符同步接收
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGCHLD);
+    sigaddset(&mask, SIGINT);
+    sigaddset(&mask, SIGTERM);
+    if (sigprocmask(SIG_BLOCK, &mask, &oldmask) < 0)
+        error_sys("sigprocmask failed");
+
+    if ((sigfd = signalfd(-1, &mask, SFD_NONBLOCK|SFD_CLOEXEC)) < 0)
+        error_sys("signalfd failed");
+
+    // 创建调度时钟，使用单调时钟按墙上时间计时，有作业时才启动
+    if ((timerfd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK|TFD_CLOEXEC)) < 0)
+        error_sys("timerfd_create failed");
+
+    // 注册事件
+    if ((epfd = epoll_create1(EPOLL_CLOEXEC)) < 0)
+        error_sys("epoll_create1 failed");
+
+    ev.events = EPOLLIN;
+    ev.data.u64 = EV_TAG(EV_FIFO, 0, 0);
+    if (epoll_ctl(epfd, EPOLL_CTL_ADD, fifo, &ev) < 0)
+        error_sys("epoll_ctl fifo failed");
+    ev.data.u64 = EV_TAG(EV_TIMER, 0, 0);
+    if (epoll_ctl(epfd, EPOLL_CTL_ADD, timerfd, &ev) < 0)
+        error_sys("epoll_ctl timerfd failed");
+    ev.data.u64 = EV_TAG(EV_SIGNAL, 0, 0);
+    if (epoll_ctl(epfd, EPOLL_CTL_ADD, sigfd, &ev) < 0)
+        error_sys("epoll_ctl signalfd failed");
+    ev.data.u64 = EV_TAG(EV_ACCEPT, 0, 0);
+    if (ctlfd >= 0 && epoll_ctl(epfd, EPOLL_CTL_ADD, ctlfd, &ev) < 0)
+        error_sys("epoll_ctl control socket failed");
+
+    printf("OK! Scheduler is starting now!! (%s, quantum %d ms, %d slots)\n",
+        policies[tmp_choose - 1].name, quantum, nslot);
+
+    // 主循环：阻塞等待事件
+    while (siginfo == 1) {
+        fflush(stdout);
+        if ((n = epoll_wait(epfd, events, 8, -1)) < 0) {
+            if (errno == EINTR)
+                continue;
+            error_sys("epoll_wait failed");
+        }
 
-    // 主循环
-    while (siginfo == 1);
+        for (i = 0; i < n; i++) {
+            tag = events[i].data.u64;
+            switch (EV_TYPE(tag)) {
+            case EV_SIGNAL:
+                do_signal();
+                break;
+            case EV_FIFO:
+                do_ingest();
+                break;
+            case EV_TIMER:
+                do_tick();
+                break;
+            case EV_ACCEPT:
+                do_accept();
+                break;
+            case EV_CONN:       // 连接可能已在本批事件中关闭，文件描述符被新连接复用
+                if (EV_HI(tag) < nconns && conns[EV_HI(tag)] != NULL &&
+                    conns[EV_HI(tag)]->serial == EV_LO(tag))
+                    do_conn(conns[EV_HI(tag)], events[i].events);
+                break;
+            case EV_PIDFD:
+                do_pidfd(EV_LO(tag));
+                break;
+            }
+        }
+    }
 
     // 清理资源
+    close(epfd);
+    close(timerfd);
+    close(sigfd);
+    close(fifo_keep);
     close(fifo);
+    for (i = 0; i < nconns; i++)
+        if (conns[i] != NULL)
+            conn_close(conns[i]);
+    if (ctlfd >= 0) {
+        close(ctlfd);
+        unlink(PROTO_SOCK);
+    }
     close(globalfd);
+    if (launchfd >= 0)
+        close(launchfd);
+    cgreap();
+    if (jobtab != NULL)
+        jobtab_destroy(jobtab);
+    if (tracer != NULL)
+        trace_close(tracer);
     return 0;
 }
@@ -0,0 +1,543 @@
+/**
+ * @file sim.c
+ * @brief 调度算法离散事件模拟器
+ * @details 不创建进程、不等待墙上时间：用虚拟时钟在合成或记录的负载上运行调度器的同一份
+ *          调度算法代码（policy.c），统计各算法的周转时间、等待时间、响应时间和上下文切换次数。
+ *          模拟遵循调度器的时序：作业到达时空闲的执行槽立即选择作业，其余作业在调度时钟参与选择；
+ *          作业结束时所在执行槽立即选择下一个作业；没有作业时调度时钟停止。
+ *          作业一直占用CPU，实际运行时间用完即结束
+ */
+
+#include <stdio.h>      // 标准输入输出
+#include <stdlib.h>     // 动态内存分配、strtol
+#include <stdint.h>     // 定长整数类型
+#include <string.h>     // 字符串处理
+#include <strings.h>    // strcasecmp
+#include <unistd.h>     // getopt
+#include <limits.h>     // LONG_MAX
+#include <math.h>       // log
+#include <time.h>       // 时钟
+#include "policy.h"     // 调度核心
+#include "pool.h"       // 作业记录内存池
+
+#define QUANTUM_MIN 5       // 时间片下限（单位：毫秒），与调度器一致
+#define QUANTUM_MAX 10000   // 时间片上限（单位：毫秒）
+
+// 负载中的一个作业
+struct simjob {
+	long arrival;           // 到达时刻（单位：毫秒）
+	int duration;           // 预计运行时间，交给调度算法
+	int need;               // 实际运行时间（单位：毫秒）
+	int defpri;             // 默认优先级
+	int owner;              // 所有者ID
+	int line;               // 在记录文件中的行号，合成负载为序号
+	long left;              // 剩余运行时间
+	long start;             // 首次运行的时刻，-1表示尚未运行
+	long finish;            // 结束时刻
+};
+
+// 一次模拟的统计结果
+struct simstat {
+	double turnaround;      // 平均周转时间（单位：毫秒）
+	double waiting;         // 平均等待时间
+	double response;        // 平均响应时间
+	long resp_p99;          // 响应时间的99百分位
+	long makespan;          // 最后一个作业结束的时刻
+	long switches;          // 作业开始或恢复运行的次数
+	long preempts;          // 运行中的作业被换下的次数
+	long steals;            // 作业被空闲执行槽窃取的次数
+	long events;            // 处理的事件数：到达、调度时钟和作业结束
+	double seconds;         // 模拟耗时（单位：秒）
+};
+
+struct simjob *work;    // 负载，按到达时刻排序，作业ID为下标加1
+int nwork;              // 负载中的作业数
+long now;               // 虚拟时钟（单位：毫秒）
+long *charged;          // 各执行槽上的作业上次记账的时刻
+int live;               // 已到达、尚未结束的作业数
+int ndone;              // 已结束的作业数
+struct simstat result;  // 正在进行的模拟的统计
+uint64_t rng = 88172645463325252ULL;    // 随机数状态
+
+/**
+ * @brief 读取单调时钟
+ * @return 当前时刻（单位：纳秒）
+ */
+uint64_t now_ns()
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/**
+ * @brief 生成伪随机数（xorshift64*）
+ * @return 64位随机数，同一种子下序列固定，结果可以复现
+ */
+uint64_t rnd()
+{
+	rng ^= rng >> 12;
+	rng ^= rng << 25;
+	rng ^= rng >> 27;
+	return rng * 2685821657736338717ULL;
+}
+
+/**
+ * @brief 指数分布随机数
+ * @param mean 均值
+ * @return 随机数
+ */
+double rnd_exp(double mean)
+{
+	return -mean * log(((rnd() >> 11) + 1.0) / 9007199254740993.0);
+}
+
+/**
+ * @brief 生成合成负载
+ * @param n 作业数
+ * @param gap 平均到达间隔（单位：毫秒），到达为泊松过程
+ * @param mean 平均运行时间（单位：毫秒），服从指数分布，限制在1-65535
+ * @details 默认优先级在0-3中均匀分布，预计运行时间与实际运行时间相同
+ */
+void gen_workload(int n, double gap, double mean)
+{
+	double t = 0, d;
+	int i;
+
+	if ((work = calloc(n, sizeof(*work))) == NULL)
+		error_sys("calloc failed");
+	for (i = 0; i < n; i++) {
+		t += rnd_exp(gap);
+		d = rnd_exp(mean);
+		work[i].arrival = (long)t;
+		work[i].duration = d < 1 ? 1 : d > 65535 ? 65535 : (int)d;
+		work[i].need = work[i].duration;
+		work[i].defpri = rnd() % 4;
+		work[i].line = i + 1;
+	}
+	nwork = n;
+}
+
+/**
+ * @brief 按到达时刻排序，同时到达的按文件中的顺序
+ */
+int arrivalcmp(const void *a, const void *b)
+{
+	const struct simjob *x = a, *y = b;
+
+	if (x->arrival != y->arrival)
+		return x->arrival < y->arrival ? -1 : 1;
+	return x->line - y->line;
+}
+
+/**
+ * @brief 读取记录的负载
+ * @param path 文件名，"-"表示标准输入
+ * @return 0表示成功，-1表示文件无法打开或格式错误
+ * @details 每行一个作业：到达时刻 预计运行时间 [默认优先级 [所有者ID [实际运行时间]]]，
+ *          时间的单位都是毫秒；空行和以#开头的行被忽略。省略的优先级为0，
+ *          省略的实际运行时间等于预计运行时间
+ */
+int load_trace(const char *path)
+{
+	FILE *fp;
+	char buf[256], *s;
+	struct simjob j;
+	int cap = 0, n, lineno = 0;
+
+	if ((fp = strcmp(path, "-") == 0 ? stdin : fopen(path, "r")) == NULL) {
+		perror(path);
+		return -1;
+	}
+	nwork = 0;
+	while (fgets(buf, sizeof(buf), fp) != NULL) {
+		lineno++;
+		for (s = buf; *s == ' ' || *s == '\t'; s++)
+			;
+		if (*s == '#' || *s == '\n' || *s == '\0')
+			continue;
+
+		memset(&j, 0, sizeof(j));
+		j.need = -1;
+		n = sscanf(s, "%ld %d %d %d %d", &j.arrival, &j.duration, &j.defpri, &j.owner, &j.need);
+		if (n < 5)
+			j.need = j.duration;
+		if (n < 2 || j.arrival < 0 || j.duration < 0 || j.duration > 65535 ||
+		    j.defpri < 0 || j.defpri > 3 || j.need < 0) {
+			fprintf(stderr, "%s:%d: invalid job\n", path, lineno);
+			goto fail;
+		}
+		if (j.need == 0)
+			j.need = 1;     // 真实的进程至少要运行一点时间
+		j.line = lineno;
+
+		if (nwork == cap) {
+			cap = cap ? cap * 2 : 1024;
+			if ((work = realloc(work, cap * sizeof(*work))) == NULL)
+				error_sys("realloc failed");
+		}
+		work[nwork++] = j;
+	}
+	if (fp != stdin)
+		fclose(fp);
+	qsort(work, nwork, sizeof(*work), arrivalcmp);
+	return 0;
+
+fail:
+	if (fp != stdin)
+		fclose(fp);
+	return -1;
+}
+
+/**
+ * @brief 执行槽上运行的作业在负载中的记录
+ */
+struct simjob *simjob(const struct jobinfo *job)
+{
+	return &work[job->jid - 1];
+}
+
+/**
+ * @brief 为运行中的作业记账，并更新调度时钟
+ * @param elapsed 距上次调度经过的时间（单位：毫秒）
+ * @details 作业一直占用CPU，实际得到的CPU时间就是它本周期内运行的时间。
+ *          时间片的消耗与调度器的记账规则一致：本周期中途才开始运行、用时不到一半的作业按整个周期计
+ */
+void updateall(int elapsed)
+{
+	struct jobinfo *job;
+	struct runslot *sl;
+	long used;
+
+	for (sl = slots; sl < slots + nslot; sl++) {
+		if (sl->current) {
+			job = sl->current->job;
+			used = now - charged[sl - slots];
+			job->run_time += used;
+			job->remaining_time -= used * 2 < elapsed ? elapsed : used;
+			simjob(job)->left -= used;
+			charged[sl - slots] = now;
+		}
+	}
+	clock_ms += elapsed;
+	jobage();
+}
+
+/**
+ * @brief 作业结束，记录结束时刻并释放作业
+ * @param job 作业
+ */
+void jobend(struct jobinfo *job)
+{
+	simjob(job)->finish = now;
+	if (job->curpri < 3)
+		wheel_remove(&agewheel, job);
+	job_release(job);
+	live--;
+	ndone++;
+}
+
+/**
+ * @brief 作业切换函数
+ * @details 与调度器的jobswitch()相同的状态转换，只是不操作进程
+ */
+void jobswitch()
+{
+	struct jobinfo *job;
+
+	// 处理已完成的作业
+	if (cur->current && cur->current->job->state == DONE) {
+		jobend(cur->current->job);
+		cur->current = NULL;
+	}
+
+	// 没有作业要运行，或选中的仍是当前作业
+	if (cur->next == NULL || cur->next == cur->current) {
+		cur->next = NULL;
+		return;
+	}
+
+	// 换下运行中的作业
+	if (cur->current) {
+		cur->current->job->state = READY;
+		result.preempts++;
+	}
+
+	// 启动或恢复选中的作业
+	cur->current = cur->next;
+	cur->next = NULL;
+	job = cur->current->job;
+	job->state = RUNNING;
+	if (simjob(job)->start < 0)
+		simjob(job)->start = now;
+	charged[cur - slots] = now;
+	result.switches++;
+}
+
+/**
+ * @brief 作业被窃取到另一个执行槽，只计数
+ */
+void jobmigrate(struct jobinfo *job)
+{
+	(void)job;
+	result.steals++;
+}
+
+/**
+ * @brief 模拟中没有作业表，不发布
+ */
+void jobpublish(const struct jobinfo *job)
+{
+	(void)job;
+}
+
+/**
+ * @brief 作业到达：创建作业记录并交给调度算法
+ * @param sj 负载中的作业，作业ID由它在负载中的位置决定
+ */
+void jobarrive(struct simjob *sj)
+{
+	struct jobinfo *job = job_alloc();
+
+	memset(job, 0, sizeof(*job));
+	job->jid = sj - work + 1;
+	job->defpri = sj->defpri;
+	job->ownerid = sj->owner;
+	job->duration = sj->duration;
+	job->pidfd = -1;
+	job->cpufd = -1;
+	job->tabrow = -1;
+	jobadmit(job, slot_pick());
+	live++;
+}
+
+/**
+ * @brief 百分位比较函数
+ */
+int longcmp(const void *a, const void *b)
+{
+	long x = *(const long *)a, y = *(const long *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+/**
+ * @brief 用一种调度算法模拟整个负载
+ * @param p 调度算法
+ * @param q 调度时钟周期（单位：毫秒）
+ * @param out 统计结果
+ * @details 每一步找出最早发生的事件：作业结束、作业到达或调度时钟，把虚拟时钟直接推进到那一刻。
+ *          同一时刻先处理结束，再处理到达，最后处理调度时钟
+ */
+void simulate(const struct policy *p, int q, struct simstat *out)
+{
+	struct runslot *sl, *endsl;
+	struct simjob *sj;
+	long next_tick = 0, last_tick = 0, t, fin, *resp;
+	double turn = 0, wait = 0, respsum = 0;
+	uint64_t t0;
+	int i, ai = 0, armed = 0;
+	enum { EV_END, EV_ARRIVE, EV_TICK } kind;
+
+	// 每种算法从相同的初始状态开始，执行槽的就绪队列在上一次模拟结束时已经为空
+	policy_use(p);
+	memset(&result, 0, sizeof(result));
+	memset(&agewheel, 0, sizeof(agewheel));
+	clock_ms = 0;
+	mlfq_next_boost = MLFQ_BOOST_MS;
+	now = 0;
+	live = ndone = 0;
+	for (i = 0; i < nwork; i++) {
+		work[i].left = work[i].need;
+		work[i].start = -1;
+	}
+
+	t0 = now_ns();
+	while (ndone < nwork) {
+		// 最早结束的作业
+		endsl = NULL;
+		fin = LONG_MAX;
+		for (sl = slots; sl < slots + nslot; sl++)
+			if (sl->current && charged[sl - slots] + simjob(sl->current->job)->left < fin) {
+				fin = charged[sl - slots] + simjob(sl->current->job)->left;
+				endsl = sl;
+			}
+		t = fin;
+		kind = EV_END;
+		if (ai < nwork && work[ai].arrival < t)
+			t = work[ai].arrival, kind = EV_ARRIVE;
+		if (armed && next_tick < t)
+			t = next_tick, kind = EV_TICK;
+		now = t;
+		result.events++;
+
+		if (kind == EV_END) {
+			// 作业结束：记入最后一段运行时间，执行槽立即选择下一个作业
+			sj = simjob(endsl->current->job);
+			endsl->current->job->run_time += now - charged[endsl - slots];
+			sj->left = 0;
+			endsl->current->job->state = DONE;
+			dispatch(endsl);
+		} else if (kind == EV_ARRIVE) {
+			// 同一时刻到达的作业作为一批入队，之后空闲的执行槽各做一次选择；没有调度时钟时启动它
+			while (ai < nwork && work[ai].arrival == now)
+				jobarrive(&work[ai++]);
+			for (sl = slots; sl < slots + nslot; sl++)
+				if (sl->current == NULL)
+					dispatch(sl);
+			if (!armed) {
+				armed = 1;
+				last_tick = now;
+				next_tick = now + q;
+			}
+		} else {
+			// 调度时钟
+			next_tick += q;
+			schedule(now - last_tick);
+			last_tick = now;
+			if (live == 0)
+				armed = 0;
+		}
+	}
+	result.seconds = (now_ns() - t0) / 1e9;
+
+	// 汇总各作业的时间
+	if ((resp = malloc(sizeof(*resp) * (nwork ? nwork : 1))) == NULL)
+		error_sys("malloc failed");
+	for (i = 0; i < nwork; i++) {
+		turn += work[i].finish - work[i].arrival;
+		wait += work[i].finish - work[i].arrival - work[i].need;
+		resp[i] = work[i].start - work[i].arrival;
+		respsum += resp[i];
+		if (work[i].finish > result.makespan)
+			result.makespan = work[i].finish;
+	}
+	qsort(resp, nwork, sizeof(*resp), longcmp);
+	if (nwork > 0) {
+		result.turnaround = turn / nwork;
+		result.waiting = wait / nwork;
+		result.response = respsum / nwork;
+		result.resp_p99 = resp[(long)(nwork - 1) * 99 / 100];
+	}
+	free(resp);
+	*out = result;
+}
+
+/**
+ * @brief 打印使用说明
+ */
+void usage()
+{
+	printf("Usage: sim [-p policy] [-n slots] [-q ms] [-m ms,ms,ms] [-j jobs] [-a ms] [-d ms] [-s seed] [trace]\n"
+		"  -p policy    simulate only this policy (HPF, FCFS, SJF, RR, HRRN, MLFQ), default all\n"
+		"  -n slots     number of execution slots, default 1\n"
+		"  -q ms        scheduling quantum, default the policy's own\n"
+		"  -m ms,ms,ms  MLFQ quanta from top to bottom level, default 10,40,160\n"
+		"  -j jobs      synthetic workload: number of jobs, default 100000\n"
+		"  -a ms        synthetic workload: mean inter-arrival time, default 50\n"
+		"  -d ms        synthetic workload: mean run time, default 40\n"
+		"  -s seed      synthetic workload: random seed\n"
+		"  trace        recorded workload, one job per line:\n"
+		"               arrival_ms duration_ms [priority [owner [actual_ms]]]\n");
+}
+
+int main(int argc, char *argv[])
+{
+	struct simstat st;
+	double gap = 50, mean = 40, busy = 0;
+	char *only = NULL, *arg, *end;
+	int i, c, n = 100000, quantum = 0, found = 0;
+
+	// 解析命令行选项
+	while ((c = getopt(argc, argv, "p:n:q:m:j:a:d:s:")) != -1) {
+		switch (c) {
+		case 'p':
+			only = optarg;
+			break;
+		case 'n':
+			nslot = atoi(optarg);
+			if (nslot < 1 || nslot > 1024) {
+				printf("invalid slot count: must between 1 and 1024\n");
+				return 1;
+			}
+			break;
+		case 'q':
+			quantum = atoi(optarg);
+			if (quantum < QUANTUM_MIN || quantum > QUANTUM_MAX) {
+				printf("invalid quantum: must between %d and %d ms\n",
+					QUANTUM_MIN, QUANTUM_MAX);
+				return 1;
+			}
+			break;
+		case 'm':
+			for (i = 0, arg = optarg; i < MLFQ_LEVELS; i++, arg = end + 1) {
+				mlfq_quantum[i] = strtol(arg, &end, 10);
+				if (end == arg || mlfq_quantum[i] < QUANTUM_MIN ||
+				    mlfq_quantum[i] > QUANTUM_MAX ||
+				    *end != (i < MLFQ_LEVELS - 1 ? ',' : '\0')) {
+					printf("invalid MLFQ quanta: need %d values between %d and %d ms\n",
+						MLFQ_LEVELS, QUANTUM_MIN, QUANTUM_MAX);
+					return 1;
+				}
+			}
+			break;
+		case 'j':
+			n = atoi(optarg);
+			break;
+		case 'a':
+			gap = atof(optarg);
+			break;
+		case 'd':
+			mean = atof(optarg);
+			break;
+		case 's':
+			rng = strtoull(optarg, NULL, 0) | 1;
+			break;
+		default:
+			usage();
+			return 1;
+		}
+	}
+	if (n < 1 || gap <= 0 || mean <= 0) {
+		usage();
+		return 1;
+	}
+
+	// 准备负载
+	if (optind < argc) {
+		if (load_trace(argv[optind]) < 0)
+			return 1;
+	} else
+		gen_workload(n, gap, mean);
+	for (i = 0; i < nwork; i++)
+		busy += work[i].need;
+	printf("workload: %d jobs over %ld ms, %d slots, offered load %.2f\n\n",
+		nwork, nwork ? work[nwork - 1].arrival : 0L, nslot,
+		nwork && work[nwork - 1].arrival ? busy / work[nwork - 1].arrival / nslot : 0);
+
+	slots_init(nslot);
+	if ((charged = calloc(nslot, sizeof(*charged))) == NULL)
+		error_sys("calloc failed");
+
+	// 逐个模拟调度算法
+	printf("%-6s %7s %11s %11s %11s %9s %9s %9s %9s %7s %9s %7s\n",
+		"POLICY", "QUANTUM", "TURNAROUND", "WAITING", "RESPONSE", "RESP_P99",
+		"MAKESPAN", "SWITCHES", "PREEMPTS", "STEALS", "EVENTS", "MEV/S");
+	for (i = 0; i < NPOLICY; i++) {
+		if (only != NULL && strcasecmp(only, policies[i].name) != 0)
+			continue;
+		found = 1;
+		c = quantum ? quantum : policy_quantum(&policies[i]);
+		simulate(&policies[i], c, &st);
+		printf("%-6s %7d %11.1f %11.1f %11.1f %9ld %9ld %9ld %9ld %7ld %9ld %7.2f\n",
+			policies[i].name, c, st.turnaround, st.waiting, st.response, st.resp_p99,
+			st.makespan, st.switches, st.preempts, st.steals, st.events,
+			st.seconds > 0 ? st.events / st.seconds / 1e6 : 0);
+	}
+	if (!found) {
+		printf("unknown policy: %s\n", only);
+		return 1;
+	}
+	return 0;
+}
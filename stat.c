@@ -4,47 +4,253 @@
 #include <sys/ipc.h>
 #include <fcntl.h>
 #include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <signal.h>
+#include <time.h>
 #include "job.h"
+#include "proto.h"
+#include "jobtab.h"
+#include <sys/socket.h>
 
 /*
  * command syntax
- *     stat
+ *     stat [-l]
+ * ˹ڴҵʱֱӶȡӡ򾭿׽ֲѯ
+ * ûʱFIFOдӡ
+ * -lʾѽҵӳٰٷλ׽ֲѯʱFIFOӡ
  */
  //ʾϢ
 void usage()
 {
-	printf ("Usage: stat\n");
+	printf ("Usage: stat [-l]\n"
+		"\t-l\t show queueing, response, turnaround and slowdown\n"
+		"\t\t percentiles of finished jobs, overall and per owner\n");
+}
+
+/**
+ * @brief Ƚеʾ˳еҵǰఴҵID
+ */
+int rowcmp(const void *a, const void *b)
+{
+	const struct statrow *x = a, *y = b;
+
+	if ((x->state == RUNNING) != (y->state == RUNNING))
+		return x->state == RUNNING ? -1 : 1;
+	return x->jid - y->jid;
+}
+
+/**
+ * @brief ӡͷ
+ */
+void showhead()
+{
+	printf("JID\tPID\tOWNER\tRUNTIME\tWAITTIME\tCREATTIME\tSTATE\tDEFPRI\tCURPRI\n");
+}
+
+/**
+ * @brief ӡһҵ
+ * @param r ҵ״̬
+ */
+void showrow(const struct statrow *r)
+{
+	char timebuf[BUFLEN];
+	time_t created = r->create_time;
+
+	strcpy(timebuf, ctime(&created));
+	timebuf[strlen(timebuf) - 1] = '\0';
+	printf("%d\t%d\t%d\t%d\t%lld\t%s\t%d\t%d\t%d\n",
+		r->jid, r->pid, r->owner, r->run_time, (long long)r->wait_time,
+		timebuf, r->state, r->defpri, r->curpri);
+}
+
+/**
+ * @brief ֱӶȡĹڴҵӡ
+ * @param t ҵ
+ * @return 0ʾɹ-1ʾҵʧЧ
+ */
+int showtab(const struct jobtab *t)
+{
+	struct statrow *rows;
+	struct jobrow r;
+	uint32_t hwm, overflow, i;
+	int64_t clock_ms;
+	int n = 0, ret;
+
+	// ˳ʱеݲٸ
+	if (kill(t->pid, 0) < 0 && errno == ESRCH)
+		return -1;
+	if (jobtab_head(t, &hwm, &overflow, &clock_ms) < 0)
+		return -1;
+	if ((rows = malloc(sizeof(*rows) * (hwm + 1))) == NULL)
+		error_sys("malloc failed");
+	for (i = 0; i < hwm; i++) {
+		if ((ret = jobtab_get(t, i, &r)) < 0) {
+			free(rows);
+			return -1;
+		}
+		if (ret == 0)
+			continue;
+		rows[n].jid = r.jid;
+		rows[n].pid = r.pid;
+		rows[n].owner = r.ownerid;
+		rows[n].run_time = r.run_time;
+		rows[n].state = r.state;
+		rows[n].defpri = r.defpri;
+		rows[n].curpri = r.curpri;
+		rows[n].wait_time = r.state == RUNNING ? r.wait_time : clock_ms - r.wait_base;
+		rows[n].create_time = r.create_time;
+		n++;
+	}
+	qsort(rows, n, sizeof(*rows), rowcmp);
+
+	showhead();
+	for (i = 0; i < (uint32_t)n; i++)
+		showrow(&rows[i]);
+	if (overflow > 0)
+		printf("(%u jobs not shown: job table full)\n", overflow);
+	free(rows);
+	return 0;
+}
+
+/**
+ * @brief ͨ׽ֲѯӡ
+ * @param fd ׽
+ * @param req ״̬ѯ֡
+ * @param len ֡
+ * @return 0ʾɹ-1ʾʧ
+ */
+int showsock(int fd, const char *req, size_t len)
+{
+	char reply[PROTO_MAXMSG];
+	struct replybody rep;
+	struct statrow row;
+	long off;
+	uint32_t i;
+
+	while (send(fd, req, len, MSG_NOSIGNAL) < 0)
+		if (errno != EINTR)
+			return -1;
+
+	showhead();
+	do {
+		if ((off = proto_recvreply(fd, reply, sizeof(reply), &rep)) < 0)
+			return -1;
+		for (i = 0; i < rep.count; i++) {
+			memcpy(&row, reply + off + i * sizeof(row), sizeof(row));
+			showrow(&row);
+		}
+	} while (rep.more);
+	return 0;
+}
+
+/**
+ * @brief ͨ׽ֲѯӳͳƲӡ
+ * @param fd ׽
+ * @return 0ʾɹ-1ʾʧ
+ */
+int showlat(int fd)
+{
+	static const char *metrics[LAT_NMETRIC] = { "QUEUE", "RESPONSE", "TURNAROUND", "SLOWDOWN" };
+	static const char *units[LAT_NMETRIC] = { "us", "us", "us", "x1000" };
+	char req[sizeof(struct msghead)], reply[PROTO_MAXMSG];
+	char policy[LAT_POLICYLEN];
+	struct replybody rep;
+	struct latrow row;
+	long off;
+	uint32_t i;
+
+	proto_head(req, MSG_LATENCY, 0);
+	while (send(fd, req, sizeof(req), MSG_NOSIGNAL) < 0)
+		if (errno != EINTR)
+			return -1;
+	if ((off = proto_recvreply(fd, reply, sizeof(reply), &rep)) < 0)
+		return -1;
+
+	memcpy(policy, reply + off, sizeof(policy));
+	policy[sizeof(policy) - 1] = '\0';
+	off += sizeof(policy);
+	printf("POLICY %s\n", policy);
+	printf("OWNER\tMETRIC\t\tUNIT\tCOUNT\tP50\tP99\tP999\tMAX\n");
+	for (i = 0; i < rep.count; i++) {
+		memcpy(&row, reply + off + i * sizeof(row), sizeof(row));
+		if (row.metric < 0 || row.metric >= LAT_NMETRIC)
+			continue;
+		if (row.owner == LAT_ALLOWNERS)
+			printf("all");
+		else
+			printf("%d", row.owner);
+		printf("\t%-10s\t%s\t%llu\t%llu\t%llu\t%llu\t%llu\n",
+			metrics[row.metric], units[row.metric], (unsigned long long)row.count,
+			(unsigned long long)row.p50, (unsigned long long)row.p99,
+			(unsigned long long)row.p999, (unsigned long long)row.max);
+	}
+	return 0;
 }
 
 int main (int argc,char *argv[])
 {
 //ҵṹ,
-	struct jobcmd statcmd;
+	struct statbody statcmd;
+	char buf[sizeof(struct msghead) + sizeof(struct statbody)];
+	struct jobtab *t;
 	int fd;
 
 
+	if (argc == 2 && strcmp(argv[1], "-l") == 0) {
+		// ӳͳƲڹڴҵУȾ׽ֲѯ
+		if ((fd = proto_connect()) >= 0) {
+			if (showlat(fd) < 0) {
+				fprintf(stderr, "stat: no reply from scheduler\n");
+				return 1;
+			}
+			close(fd);
+			return 0;
+		}
+		if ((fd = open(FIFO, O_WRONLY)) < 0)
+			error_sys("stat open fifo failed");
+		if (proto_send(fd, buf, proto_head(buf, MSG_LATENCY, 0)) < 0)
+			error_sys("stat write failed");
+		close(fd);
+		return 0;
+	}
+
 	if (argc !=1)
 	{
 		usage();
 		return 1;
 	}
 
-   statcmd.type = STAT;
-   statcmd.defpri = 0;
+   // ֱӶȡڴҵ
+   if ((t = jobtab_open()) != NULL) {
+	   if (showtab(t) == 0)
+		   return 0;
+	   fprintf(stderr, "stat: scheduler is not running\n");
+	   return 1;
+   }
+
    statcmd.owner = getuid();
-   statcmd.argnum = 0;
-   strcpy(statcmd.data, "\0");
+   memcpy(buf + proto_head(buf, MSG_STAT, sizeof(statcmd)), &statcmd, sizeof(statcmd));
+
+   // ξ׽ֲѯ
+   if ((fd = proto_connect()) >= 0) {
+	   if (showsock(fd, buf, sizeof(buf)) < 0) {
+		   fprintf(stderr, "stat: no reply from scheduler\n");
+		   return 1;
+	   }
+	   close(fd);
+	   return 0;
+   }
+
+   // ûʱɵԼдӡ
 
    if ((fd = open(FIFO,O_WRONLY)) < 0 )
 	   error_sys("stat open fifo failed");
 
-   if (write(fd,&statcmd,DATALEN) < 0)
+   if (proto_send(fd, buf, sizeof(buf)) < 0)
 	   error_sys("stat write failed");
 
    close (fd);
    return 0;
 }
-
-
-
-
@@ -0,0 +1,158 @@
+/**
+ * @file trace.c
+ * @brief 调度事件跟踪环实现
+ */
+
+#include <stdio.h>      // perror
+#include <string.h>     // 字符串处理
+#include <unistd.h>     // ftruncate、getpid
+#include <fcntl.h>      // O_*常量
+#include <time.h>       // clock_gettime
+#include <sys/mman.h>   // shm_open、mmap
+#include <sys/stat.h>   // fstat
+#include "trace.h"      // 跟踪环定义
+
+#define TRACE_SIZE(n) (sizeof(struct tracering) + sizeof(struct traceev) * (size_t)(n))
+
+/**
+ * @brief 创建跟踪环
+ * @param policy 调度算法名
+ * @param nslot 执行槽个数
+ * @param size 容量（记录数），向上取整到2的幂
+ * @return 映射的跟踪环，失败时返回NULL
+ * @details 先删除上次运行遗留的对象
+ */
+struct tracering *trace_create(const char *policy, int nslot, uint32_t size)
+{
+	struct tracering *t;
+	uint32_t n;
+	int fd;
+
+	for (n = TRACE_MINEVENTS; n < size && n < TRACE_MAXEVENTS; n <<= 1)
+		;
+	shm_unlink(TRACE_NAME);
+	if ((fd = shm_open(TRACE_NAME, O_RDWR|O_CREAT|O_EXCL|O_CLOEXEC, 0644)) < 0) {
+		perror("shm_open");
+		return NULL;
+	}
+	if (ftruncate(fd, TRACE_SIZE(n)) < 0) {
+		perror("ftruncate");
+		goto fail;
+	}
+	t = mmap(NULL, TRACE_SIZE(n), PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0);
+	if (t == MAP_FAILED) {
+		perror("mmap");
+		goto fail;
+	}
+	close(fd);
+
+	t->version = TRACE_VERSION;
+	t->pid = getpid();
+	t->nslot = nslot;
+	t->size = n;
+	strncpy(t->policy, policy, sizeof(t->policy) - 1);
+	// 魔数最后写入，读者看到魔数时其他字段已就绪
+	__atomic_store_n(&t->magic, TRACE_MAGIC, __ATOMIC_RELEASE);
+	return t;
+
+fail:
+	close(fd);
+	shm_unlink(TRACE_NAME);
+	return NULL;
+}
+
+/**
+ * @brief 解除跟踪环的映射
+ * @param t trace_create()返回的跟踪环
+ * @details 不删除共享内存对象，调度器退出后仍可导出
+ */
+void trace_close(struct tracering *t)
+{
+	munmap(t, TRACE_SIZE(t->size));
+}
+
+/**
+ * @brief 记录一个事件
+ * @param t 跟踪环
+ * @param type 事件类型
+ * @param slot 执行槽
+ * @param jid 作业ID
+ * @param pid 进程ID
+ * @param arg 附加参数
+ * @details 先写记录，再推进写位置，读者看到新的写位置时记录已完整
+ */
+void trace_emit(struct tracering *t, int type, int slot, int jid, int pid, int arg)
+{
+	struct traceev *e = &t->ev[t->head & (t->size - 1)];
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	e->ts = (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+	e->type = type;
+	e->slot = slot;
+	e->jid = jid;
+	e->pid = pid;
+	e->arg = arg;
+	__atomic_store_n(&t->head, t->head + 1, __ATOMIC_RELEASE);
+}
+
+/**
+ * @brief 以只读方式映射跟踪环
+ * @return 跟踪环，没有跟踪环或格式不符时返回NULL
+ */
+struct tracering *trace_open()
+{
+	struct tracering *t;
+	struct stat st;
+	uint32_t size;
+	int fd;
+
+	if ((fd = shm_open(TRACE_NAME, O_RDONLY|O_CLOEXEC, 0)) < 0)
+		return NULL;
+	if (fstat(fd, &st) < 0 || (size_t)st.st_size < TRACE_SIZE(TRACE_MINEVENTS)) {
+		close(fd);
+		return NULL;
+	}
+	t = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (t == MAP_FAILED)
+		return NULL;
+	size = t->size;
+	if (__atomic_load_n(&t->magic, __ATOMIC_ACQUIRE) != TRACE_MAGIC ||
+	    t->version != TRACE_VERSION || TRACE_SIZE(size) != (size_t)st.st_size ||
+	    (size & (size - 1)) != 0) {
+		munmap(t, st.st_size);
+		return NULL;
+	}
+	return t;
+}
+
+/**
+ * @brief 复制跟踪环中的记录
+ * @param t 跟踪环
+ * @param out 输出，至少t->size条
+ * @param head 输出最后一条记录的序号加1
+ * @return 复制的记录数，按时间顺序排列
+ * @details 复制后再读一次写位置，写者在复制期间已经越过的记录可能被覆盖，一并丢弃
+ */
+uint32_t trace_snapshot(const struct tracering *t, struct traceev *out, uint64_t *head)
+{
+	uint64_t h1, h2, first, i;
+	uint32_t mask = t->size - 1;
+
+	h1 = __atomic_load_n(&t->head, __ATOMIC_ACQUIRE);
+	first = h1 > t->size ? h1 - t->size : 0;
+	for (i = first; i < h1; i++)
+		memcpy(&out[i - first], &t->ev[i & mask], sizeof(*out));
+	__atomic_thread_fence(__ATOMIC_ACQUIRE);
+	h2 = __atomic_load_n(&t->head, __ATOMIC_RELAXED);
+
+	// 写者正在写序号h2的记录，它与序号h2-size的记录在同一位置
+	if (h2 >= t->size && h2 - t->size + 1 > first) {
+		i = h2 - t->size + 1 < h1 ? h2 - t->size + 1 - first : h1 - first;
+		memmove(out, out + i, sizeof(*out) * (h1 - first - i));
+		first += i;
+	}
+	*head = h1;
+	return h1 - first;
+}
@@ -0,0 +1,67 @@
+/**
+ * @file trace.h
+ * @brief 调度事件跟踪环
+ * @details 调度器启用跟踪时把入队、选中、暂停、恢复、结束、出队等事件以定长二进制记录
+ *          写入/dev/shm中的环形缓冲区，每条记录带单调时钟的纳秒时间戳。调度器是唯一的写者：
+ *          先写记录再以release语义推进写位置，从不加锁也不等待读者；环满后覆盖最旧的记录。
+ *          读者随时复制整个环，复制前后各读一次写位置，丢弃复制期间可能被覆盖的记录。
+ *          调度器退出后环仍保留，直到下次启用跟踪时重建，trace2json可以事后导出
+ */
+
+#ifndef _TRACE_H
+#define _TRACE_H
+
+#include <stdint.h>
+
+#define TRACE_NAME "/jobtrace"      // 共享内存对象名，对应/dev/shm/jobtrace
+#define TRACE_MAGIC 0x4a545231      // 头部魔数
+#define TRACE_VERSION 1             // 记录格式版本
+#define TRACE_MINEVENTS 1024        // 环的容量下限（记录数）
+#define TRACE_MAXEVENTS (1 << 24)   // 环的容量上限（记录数）
+
+// 事件类型
+#define TRACE_ENQ     1     // 作业入队，arg为默认优先级
+#define TRACE_SELECT  2     // 执行槽选中作业开始运行，arg为被换下的作业ID，0表示执行槽原本空闲
+#define TRACE_SPAWN   3     // 首次运行时创建进程
+#define TRACE_STOP    4     // 暂停作业（SIGSTOP或冻结cgroup）
+#define TRACE_CONT    5     // 恢复作业（SIGCONT或解冻cgroup）
+#define TRACE_EXIT    6     // 作业进程结束，arg为退出码，被信号终止时为信号编号的相反数
+#define TRACE_DEQ     7     // 作业出队，arg为出队时的作业状态
+#define TRACE_MIGRATE 8     // 作业被窃取到另一个执行槽，slot为新执行槽
+#define TRACE_FAIL    9     // 无法创建进程，作业被丢弃
+#define TRACE_NTYPE   10
+
+// 一条事件记录
+struct traceev {
+    uint64_t ts;            // 单调时钟（单位：纳秒）
+    int32_t  type;          // 事件类型
+    int32_t  slot;          // 执行槽
+    int32_t  jid;           // 作业ID
+    int32_t  pid;           // 进程ID，0表示尚未创建进程
+    int32_t  arg;           // 附加参数，含义见事件类型
+    int32_t  pad;
+};
+
+// 环的头部，后接size条记录；导出文件格式相同，记录按时间顺序排列，head为最后一条的序号加1
+struct tracering {
+    uint32_t magic;         // 魔数
+    uint32_t version;       // 记录格式版本
+    int32_t  pid;           // 调度器进程号
+    int32_t  nslot;         // 执行槽个数
+    char     policy[16];    // 调度算法名
+    uint32_t size;          // 容量（记录数），2的幂
+    uint32_t pad;
+    uint64_t head;          // 已写入的记录总数，下一条写在head % size处
+    struct traceev ev[];
+};
+
+// 调度器
+struct tracering *trace_create(const char *policy, int nslot, uint32_t size);
+void trace_close(struct tracering *t);
+void trace_emit(struct tracering *t, int type, int slot, int jid, int pid, int arg);
+
+// 读者
+struct tracering *trace_open(void);
+uint32_t trace_snapshot(const struct tracering *t, struct traceev *out, uint64_t *head);
+
+#endif
@@ -0,0 +1,360 @@
+/**
+ * @file trace2json.c
+ * @brief 调度事件跟踪导出工具
+ * @details 复制调度器的跟踪环（见trace.h），或读取先前导出的二进制文件，转换为Chrome跟踪
+ *          事件格式的JSON，可以在chrome://tracing或Perfetto中查看。时间线分两组：
+ *          每个执行槽一条，显示依次在其上运行的作业；每个作业一条，显示它等待和运行的时段，
+ *          入队、创建进程、结束、出队等事件标为瞬时事件。也可以只把跟踪环原样导出为二进制文件，
+ *          尽快保存现场，稍后再转换
+ */
+
+#include <stdio.h>      // 标准输入输出
+#include <stdlib.h>     // 动态内存分配
+#include <stdint.h>     // 定长整数类型
+#include <string.h>     // 字符串处理
+#include <unistd.h>     // getopt
+#include "job.h"        // 作业状态、error_sys
+#include "trace.h"      // 跟踪环定义
+
+#define PID_SLOTS 1     // 执行槽时间线所在的进程号
+#define PID_JOBS 2      // 作业时间线所在的进程号
+
+// 作业当前所处的时段
+struct jobspan {
+	int state;              // READY、RUNNING，DONE表示没有打开的时段
+	uint64_t since;         // 时段开始时刻
+	int pid;                // 进程ID
+	int seen;               // 是否已输出时间线名称
+};
+
+// 执行槽上正在运行的作业
+struct slotspan {
+	int jid;                // 作业ID，0表示空闲
+	int pid;                // 进程ID
+	uint64_t since;         // 开始运行的时刻
+};
+
+static const char *names[TRACE_NTYPE] = {
+	"?", "enq", "select", "spawn", "stop", "cont", "exit", "deq", "migrate", "fail"
+};
+
+struct jobspan *jobspans = NULL;    // 按作业ID索引
+int njobspans = 0;                  // jobspans数组长度
+struct slotspan *slotspans = NULL;  // 按执行槽索引
+int nslotspans = 0;                 // slotspans数组长度
+uint64_t base;                      // 第一条记录的时刻，输出的时间相对于它
+int nout = 0;                       // 已输出的事件数
+
+/**
+ * @brief 打印使用说明
+ */
+void usage()
+{
+	printf("Usage: trace2json [-d dumpfile] [file]\n"
+		"  (no file)    convert the scheduler's trace ring to Chrome trace JSON on stdout\n"
+		"  file         convert a binary dump written by -d instead\n"
+		"  -d dumpfile  copy the trace ring to a binary file without converting\n");
+}
+
+/**
+ * @brief 开始输出一个事件，事件之间加逗号
+ */
+void out_begin()
+{
+	printf(nout++ > 0 ? ",\n" : "\n");
+}
+
+/**
+ * @brief 输出一个时段
+ * @param name 名称
+ * @param pid 时间线所在的进程号
+ * @param tid 时间线号
+ * @param start 开始时刻
+ * @param end 结束时刻
+ * @param jid 作业ID
+ * @param jobpid 作业进程ID
+ */
+void out_span(const char *name, int pid, int tid, uint64_t start, uint64_t end, int jid, int jobpid)
+{
+	out_begin();
+	printf("{\"name\":\"%s\",\"ph\":\"X\",\"pid\":%d,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f,"
+		"\"args\":{\"jid\":%d,\"pid\":%d}}",
+		name, pid, tid, (start - base) / 1000.0, (end - start) / 1000.0, jid, jobpid);
+}
+
+/**
+ * @brief 输出时间线名称
+ * @param pid 进程号
+ * @param tid 时间线号
+ * @param fmt 名称格式
+ * @param n 名称中的编号
+ */
+void out_thread(int pid, int tid, const char *fmt, int n)
+{
+	out_begin();
+	printf("{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":%d,\"args\":{\"name\":\"",
+		pid, tid);
+	printf(fmt, n);
+	printf("\"}}");
+	out_begin();
+	printf("{\"name\":\"thread_sort_index\",\"ph\":\"M\",\"pid\":%d,\"tid\":%d,"
+		"\"args\":{\"sort_index\":%d}}", pid, tid, tid);
+}
+
+/**
+ * @brief 取作业的当前时段，按需扩大数组
+ * @param e 记录
+ * @return 作业的时段
+ */
+struct jobspan *jobspan_get(const struct traceev *e)
+{
+	struct jobspan *j;
+	int n;
+
+	if (e->jid >= njobspans) {
+		n = (e->jid + 1) * 2;
+		if ((jobspans = realloc(jobspans, sizeof(*jobspans) * n)) == NULL)
+			error_sys("realloc failed");
+		memset(jobspans + njobspans, 0, sizeof(*jobspans) * (n - njobspans));
+		njobspans = n;
+	}
+	j = &jobspans[e->jid];
+	if (!j->seen) {
+		j->seen = 1;
+		j->state = DONE;
+		out_thread(PID_JOBS, e->jid, "job %d", e->jid);
+	}
+	if (e->pid > 0)
+		j->pid = e->pid;
+	return j;
+}
+
+/**
+ * @brief 取执行槽上的运行时段，按需扩大数组
+ * @param slot 执行槽
+ * @return 执行槽的时段
+ */
+struct slotspan *slotspan_get(int slot)
+{
+	int i, n;
+
+	if (slot >= nslotspans) {
+		n = slot + 1;
+		if ((slotspans = realloc(slotspans, sizeof(*slotspans) * n)) == NULL)
+			error_sys("realloc failed");
+		memset(slotspans + nslotspans, 0, sizeof(*slotspans) * (n - nslotspans));
+		for (i = nslotspans; i < n; i++)
+			out_thread(PID_SLOTS, i, "slot %d", i);
+		nslotspans = n;
+	}
+	return &slotspans[slot];
+}
+
+/**
+ * @brief 结束作业的当前时段
+ * @param j 作业的时段
+ * @param jid 作业ID
+ * @param ts 结束时刻
+ */
+void job_close(struct jobspan *j, int jid, uint64_t ts)
+{
+	if (j->state != DONE)
+		out_span(j->state == RUNNING ? "running" : "ready", PID_JOBS, jid, j->since, ts, jid, j->pid);
+	j->state = DONE;
+}
+
+/**
+ * @brief 结束执行槽上的运行时段
+ * @param s 执行槽的时段
+ * @param slot 执行槽
+ * @param jid 只结束该作业的时段，0表示不论哪个作业
+ * @param ts 结束时刻
+ */
+void slot_close(struct slotspan *s, int slot, int jid, uint64_t ts)
+{
+	char name[32];
+
+	if (s->jid == 0 || (jid != 0 && s->jid != jid))
+		return;
+	snprintf(name, sizeof(name), "job %d", s->jid);
+	out_span(name, PID_SLOTS, slot, s->since, ts, s->jid, s->pid);
+	s->jid = 0;
+}
+
+/**
+ * @brief 输出瞬时事件
+ * @param e 记录
+ */
+void out_instant(const struct traceev *e)
+{
+	out_begin();
+	printf("{\"name\":\"%s\",\"ph\":\"i\",\"s\":\"t\",\"pid\":%d,\"tid\":%d,\"ts\":%.3f,"
+		"\"args\":{\"slot\":%d,\"pid\":%d,\"arg\":%d}}",
+		names[e->type], PID_JOBS, e->jid, (e->ts - base) / 1000.0, e->slot, e->pid, e->arg);
+}
+
+/**
+ * @brief 转换为Chrome跟踪事件格式
+ * @param hdr 跟踪环头部
+ * @param ev 按时间顺序排列的记录
+ * @param n 记录数
+ */
+void convert(const struct tracering *hdr, const struct traceev *ev, uint32_t n)
+{
+	const struct traceev *e;
+	struct jobspan *j;
+	struct slotspan *s;
+	char policy[sizeof(hdr->policy) + 1];
+	uint64_t last;
+	uint32_t i;
+	int k;
+
+	memcpy(policy, hdr->policy, sizeof(hdr->policy));
+	policy[sizeof(hdr->policy)] = '\0';
+	base = n > 0 ? ev[0].ts : 0;
+	last = n > 0 ? ev[n - 1].ts : 0;
+
+	printf("{\"displayTimeUnit\":\"ns\",\"otherData\":{\"policy\":\"%s\",\"slots\":%d,"
+		"\"events\":%u,\"dropped\":%llu},\"traceEvents\":[",
+		policy, hdr->nslot, n, (unsigned long long)(hdr->head - n));
+	out_begin();
+	printf("{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,\"args\":{\"name\":\"slots (%s)\"}}",
+		PID_SLOTS, policy);
+	out_begin();
+	printf("{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,\"args\":{\"name\":\"jobs\"}}",
+		PID_JOBS);
+	slotspan_get(hdr->nslot > 0 ? hdr->nslot - 1 : 0);
+
+	for (i = 0; i < n; i++) {
+		e = &ev[i];
+		if (e->type <= 0 || e->type >= TRACE_NTYPE || e->jid <= 0 || e->slot < 0)
+			continue;
+		j = jobspan_get(e);
+		s = slotspan_get(e->slot);
+
+		switch (e->type) {
+		case TRACE_ENQ:         // 开始等待
+			job_close(j, e->jid, e->ts);
+			j->state = READY;
+			j->since = e->ts;
+			out_instant(e);
+			break;
+		case TRACE_SELECT:      // 结束等待，开始运行
+			slot_close(s, e->slot, 0, e->ts);
+			s->jid = e->jid;
+			s->pid = j->pid;
+			s->since = e->ts;
+			job_close(j, e->jid, e->ts);
+			j->state = RUNNING;
+			j->since = e->ts;
+			break;
+		case TRACE_STOP:        // 结束运行，回到等待
+			slot_close(s, e->slot, e->jid, e->ts);
+			job_close(j, e->jid, e->ts);
+			j->state = READY;
+			j->since = e->ts;
+			break;
+		case TRACE_SPAWN:       // 进程号在创建进程时才确定
+			if (s->jid == e->jid)
+				s->pid = e->pid;
+			out_instant(e);
+			break;
+		case TRACE_CONT:
+			break;
+		case TRACE_EXIT:        // 作业结束
+		case TRACE_DEQ:
+		case TRACE_FAIL:
+			slot_close(s, e->slot, e->jid, e->ts);
+			job_close(j, e->jid, e->ts);
+			out_instant(e);
+			break;
+		default:
+			out_instant(e);
+			break;
+		}
+	}
+
+	// 跟踪结束时仍未结束的时段截止到最后一条记录
+	for (k = 0; k < nslotspans; k++)
+		slot_close(&slotspans[k], k, 0, last);
+	for (k = 0; k < njobspans; k++)
+		if (jobspans[k].seen)
+			job_close(&jobspans[k], k, last);
+	printf("\n]}\n");
+}
+
+int main(int argc, char *argv[])
+{
+	struct tracering *t, hdr;
+	struct traceev *ev;
+	const char *dumpfile = NULL;
+	uint64_t head;
+	uint32_t n;
+	long size;
+	FILE *fp;
+	int c;
+
+	while ((c = getopt(argc, argv, "d:")) != -1) {
+		switch (c) {
+		case 'd':
+			dumpfile = optarg;
+			break;
+		default:
+			usage();
+			return 1;
+		}
+	}
+	if (optind < argc - 1 || (dumpfile != NULL && optind < argc)) {
+		usage();
+		return 1;
+	}
+
+	if (optind == argc) {
+		// 复制调度器的跟踪环
+		if ((t = trace_open()) == NULL) {
+			fprintf(stderr, "trace2json: no trace ring, start the scheduler with -t\n");
+			return 1;
+		}
+		if ((ev = malloc(sizeof(*ev) * t->size)) == NULL)
+			error_sys("malloc failed");
+		n = trace_snapshot(t, ev, &head);
+		memcpy(&hdr, t, sizeof(hdr));
+		hdr.head = head;
+		hdr.size = n;
+	} else {
+		// 读取导出的二进制文件
+		if ((fp = fopen(argv[optind], "rb")) == NULL)
+			error_sys("open dump failed");
+		if (fread(&hdr, sizeof(hdr), 1, fp) != 1 || hdr.magic != TRACE_MAGIC ||
+		    hdr.version != TRACE_VERSION) {
+			fprintf(stderr, "trace2json: %s is not a trace dump\n", argv[optind]);
+			return 1;
+		}
+		fseek(fp, 0, SEEK_END);
+		size = ftell(fp) - sizeof(hdr);
+		fseek(fp, sizeof(hdr), SEEK_SET);
+		n = size / sizeof(*ev);
+		if (n != hdr.size) {
+			fprintf(stderr, "trace2json: %s is truncated\n", argv[optind]);
+			return 1;
+		}
+		if ((ev = malloc(sizeof(*ev) * (n + 1))) == NULL)
+			error_sys("malloc failed");
+		if (fread(ev, sizeof(*ev), n, fp) != n)
+			error_sys("read dump failed");
+		fclose(fp);
+	}
+
+	if (dumpfile != NULL) {
+		if ((fp = fopen(dumpfile, "wb")) == NULL)
+			error_sys("open dump failed");
+		if (fwrite(&hdr, sizeof(hdr), 1, fp) != 1 || fwrite(ev, sizeof(*ev), n, fp) != n ||
+		    fclose(fp) != 0)
+			error_sys("write dump failed");
+		fprintf(stderr, "trace2json: %u events written to %s\n", n, dumpfile);
+	} else {
+		convert(&hdr, ev, n);
+	}
+	free(ev);
+	return 0;
+}